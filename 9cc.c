@@ -12,7 +12,55 @@
 #include <stdbool.h>
 #include <time.h>
 #include <ctype.h>
+#include <errno.h>
+#include <sys/resource.h>
 #include "libutils.h"
+#include "cache.h"
+
+#define MAX_STEPS  3
+
+/**
+ * A job carries one input through a chain of
+ * commands (e.g. cc1 then as), one at a time.
+ */
+struct job {
+    char **steps[MAX_STEPS];    // commands, argv[0] is the program
+    int nsteps;
+    int step;                   // current step
+    bool pipe;                  // run all steps at once through a pipe
+    pid_t pid;                  // running process, 0 if none
+    pid_t pid2;                 // reader of the pipe, 0 if none
+    struct timespec start;      // when 'pid' started
+    struct timespec start2;     // when 'pid2' started
+    char *ofile;                // final output, removed if failed
+    char *unit;                 // output of a batched cc1 unit, if any
+    struct batch *batch;        // the batch of 'unit'
+    char *ifile;                // input file
+    char *ppfile;               // preprocessed input, if cached
+    char *key;                  // cache key, set after preprocessing
+    int token;                  // jobserver token held, -1 if none
+    bool failed;
+};
+
+/**
+ * Several .c inputs are compiled by one cc1 process,
+ * the units are listed in a manifest file.
+ */
+struct batch {
+    char *manifest;
+    FILE *fp;
+    int nunits;
+    int nfails;                 // units with no output
+};
+
+// resource usage of one subprocess, for -time
+struct timing {
+    const char *input;
+    const char *stage;          // cpp, cc1, as or ld
+    double wall, user, sys;     // seconds
+    long maxrss;                // peak RSS in KB
+    long minflt, majflt;        // page faults
+};
 
 static char *ld[];
 static char *as[];
@@ -23,10 +71,29 @@ static char cflag;
 static char Eflag;
 static char Sflag;
 static char ast_dump;
+static char pipeflag;
+static char vflag;
+static char Mflag;
+static char MDflag;
+static char MTflag;
+static char MFflag;
+static char cacheflag;
+static const char *cache_dir;
+static long cache_size = 512L * 1024 * 1024;
 static char **ld_options;
 static char **cc_options;
+static char **cpp_options;
+static char **dep_options;
 static const char *tmpdir;
 static const char *progname = "9cc";
+static long njobs;
+static long unity;
+static char timeflag;
+static const char *time_file;
+static struct vector *timings;
+static const char *server_path;
+static int jobserver_rfd = -1;
+static int jobserver_wfd = -1;
 
 static void error(const char *fmt, ...)
 {
@@ -53,14 +120,39 @@ static void usage(void)
             "  -Dname          Define a macro\n"
             "  -Dname=value    Define a macro with value\n"
             "  -E              Only run the preprocessor\n"
+            "  -fcache[=<dir>] Cache the outputs by preprocessed source (default dir: ~/.cache/9cc)\n"
+            "  -fcache-size=<n>[KMG]\n"
+            "                  Limit the size of the cache (default: 512M)\n"
+            "  -fcpp-report[=json=<file>]\n"
+            "                  Report the preprocessing cost of each header\n"
+            "  -flexer=switch  Lex punctuators with the old hand-written switch\n"
+            "  -fmacro-report=<n>\n"
+            "                  Report the n macros producing the most tokens and time\n"
+            "  -freadahead     Read the headers ahead in a helper thread\n"
+            "  -funity=<n>     Compile up to n .c inputs as one unit when linking\n"
             "  -h, --help      Display available options\n"
             "  -Idir           Add dir to include search path\n"
+            "  -include-pch <file>\n"
+            "                  Start each input with a precompiled header\n"
+            "  -j N            Run up to N jobs at once (default: online cpus)\n"
             "  -Ldir           Add dir to library search path\n"
             "  -lx             Search for library x\n"
+            "  -M, -MM         Only write the make rule of each input, -MM\n"
+            "                  leaves out the system headers\n"
+            "  -MD, -MMD       Write the make rule to a .d file while compiling\n"
+            "  -MF <file>      Write the rule to <file>\n"
+            "  -MP             Add a phony target for each header\n"
+            "  -MT <target>    Set the target of the rule\n"
             "  -o <file>       Write output to <file>\n"
+            "  -pipe           Pipe the assembly to the assembler\n"
             "  -S              Only run preprocess and compilation steps\n"
+            "  -time[=<file>]  Report time and memory of each subprocess,\n"
+            "                  or append them to <file> as JSON lines\n"
             "  -Uname          Undefine a macro\n"
-            "  -v, --version   Display version and options\n"
+            "  --use-server[=<socket>]\n"
+            "                  Send compilations to a running 'cc1 --server'\n"
+            "  -v, --version   Display version and options, or\n"
+            "                  be verbose when there are input files\n"
             "  -Wall           Enable all warnings\n"
             "  -Werror         Treat warnings as errors\n");
 }
@@ -70,6 +162,7 @@ static void parse_opts(int argc, char *argv[])
     struct list *ilist = NULL;
     struct list *clist = NULL;
     struct list *dlist = NULL;
+    struct list *mlist = NULL;
 
     for (int i = 1; i < argc; i++) {
         char *arg = argv[i];
@@ -77,12 +170,77 @@ static void parse_opts(int argc, char *argv[])
             if (++i >= argc)
                 error("missing file name after '-o'");
             output = argv[i];
+        } else if (!strcmp(arg, "-v")) {
+            vflag = true;
         } else if (!strcmp(arg, "-h") || !strcmp(arg, "--help") ||
-                   !strcmp(arg, "-v") || !strcmp(arg, "--version")) {
+                   !strcmp(arg, "--version")) {
             usage();
             exit(EXIT_FAILURE);
+        } else if (!strcmp(arg, "-fcache")) {
+            cacheflag = true;
+        } else if (!strncmp(arg, "-fcache=", 8)) {
+            cacheflag = true;
+            cache_dir = arg + 8;
+        } else if (!strncmp(arg, "-fcache-size=", 13)) {
+            char *end;
+            cache_size = strtol(arg + 13, &end, 10);
+            if (*end == 'K' || *end == 'k')
+                cache_size <<= 10, end++;
+            else if (*end == 'M' || *end == 'm')
+                cache_size <<= 20, end++;
+            else if (*end == 'G' || *end == 'g')
+                cache_size <<= 30, end++;
+            if (*end || cache_size <= 0)
+                error("invalid cache size: %s", arg + 13);
+        } else if (!strncmp(arg, "-funity=", 8)) {
+            unity = atol(arg + 8);
+            if (unity <= 0)
+                error("invalid number of units: %s", arg + 8);
+        } else if (!strncmp(arg, "-j", 2)) {
+            const char *n = arg[2] ? arg + 2 : (++i < argc ? argv[i] : NULL);
+            if (n == NULL)
+                error("missing number after '-j'");
+            njobs = atol(n);
+            if (njobs <= 0)
+                error("invalid number of jobs: %s", n);
         } else if (!strcmp(arg, "-c")) {
             cflag = true;
+        } else if (!strcmp(arg, "--use-server")) {
+            server_path = sock_default_path();
+            if (server_path == NULL)
+                fprintf(stderr, "%s: no private directory for the "
+                        "compile server socket, not using it\n", progname);
+        } else if (!strncmp(arg, "--use-server=", 13)) {
+            server_path = arg + 13;
+        } else if (!strcmp(arg, "-time")) {
+            timeflag = true;
+        } else if (!strncmp(arg, "-time=", 6)) {
+            timeflag = true;
+            time_file = arg + 6;
+        } else if (!strcmp(arg, "-pipe")) {
+            pipeflag = true;
+        } else if (!strcmp(arg, "-M") || !strcmp(arg, "-MM")) {
+            Mflag = true;
+            mlist = list_append(mlist, arg);
+        } else if (!strcmp(arg, "-MD") || !strcmp(arg, "-MMD")) {
+            MDflag = true;
+            mlist = list_append(mlist, arg);
+        } else if (!strcmp(arg, "-MP")) {
+            mlist = list_append(mlist, arg);
+        } else if (!strcmp(arg, "-MF") || !strcmp(arg, "-MT")) {
+            if (++i >= argc)
+                error("missing argument after '%s'", arg);
+            if (arg[2] == 'F')
+                MFflag = true;
+            else
+                MTflag = true;
+            // joined, so cc1 never takes it for an input
+            mlist = list_append(mlist, format("%s%s", arg, argv[i]));
+        } else if (!strcmp(arg, "-include-pch")) {
+            if (++i >= argc)
+                error("missing file name after '%s'", arg);
+            clist = list_append(clist, arg);
+            clist = list_append(clist, argv[i]);
         } else if (!strcmp(arg, "-S")) {
             Sflag = true;
         } else if (!strcmp(arg, "-E")) {
@@ -100,6 +258,11 @@ static void parse_opts(int argc, char *argv[])
                    !strncmp(arg, "-std=", 5) ||
                    !strncmp(arg, "-O", 2) ||
                    !strcmp(arg, "-ansi") ||
+                   !strcmp(arg, "-freadahead") ||
+                   !strcmp(arg, "-flexer=switch") ||
+                   !strcmp(arg, "-fcpp-report") ||
+                   !strncmp(arg, "-fcpp-report=json=", 18) ||
+                   !strncmp(arg, "-fmacro-report=", 15) ||
                    !strncmp(arg, "-debug", 6)) {
             clist = list_append(clist, arg);
         } else if (!strncmp(arg, "-l", 2) ||
@@ -116,9 +279,21 @@ static void parse_opts(int argc, char *argv[])
     clist = list_append(clist, "-fleading_underscore");
 #endif
 
+    // -v alone shows the version
+    if (vflag && ilist == NULL) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
     inputs = ltoa(&ilist, PERM);
     cc_options = ltoa(&clist, PERM);
     ld_options = ltoa(&dlist, PERM);
+    dep_options = ltoa(&mlist, PERM);
+    // preprocessing for the cache key
+    for (int i = 0; cc_options[i]; i++)
+        clist = list_append(clist, cc_options[i]);
+    clist = list_append(clist, "-E");
+    cpp_options = ltoa(&clist, PERM);
 }
 
 static char *tempname(const char *dir, const char *hint)
@@ -127,13 +302,19 @@ static char *tempname(const char *dir, const char *hint)
     const char *base = basename(strdup(hint));
     const char *name = base;
     const char *path;
+    int fd;
 
+    /**
+     * Reserve the name by creating the file, since jobs
+     * are planned before any of them writes its output.
+     */
  beg:
     path = join(dir, name);
-    if (fexists(path)) {
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600)) < 0) {
         name = format("%d.%s", index++, base);
         goto beg;
     }
+    close(fd);
     return (char *)path;
 }
 
@@ -169,24 +350,610 @@ static char **compose(char *argv[], char *ifiles[],
     return av;
 }
 
+static double elapsed(struct timespec start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static const char *stage_name(char **argv)
+{
+    if (argv[0] != cc[0])
+        return basename(strdup(argv[0]));
+    for (int i = 1; argv[i]; i++)
+        if (!strcmp(argv[i], "-E"))
+            return "cpp";
+    return "cc1";
+}
+
+static void add_timing(const char *input, const char *stage,
+                       struct timespec start, struct rusage *ru)
+{
+    struct timing *t;
+
+    if (!timeflag)
+        return;
+    t = zmalloc(sizeof(struct timing));
+    t->input = input;
+    t->stage = stage;
+    t->wall = elapsed(start);
+    t->user = ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / 1e6;
+    t->sys = ru->ru_stime.tv_sec + ru->ru_stime.tv_usec / 1e6;
+    // KB on Linux, bytes on Darwin
+#ifdef CONFIG_DARWIN
+    t->maxrss = ru->ru_maxrss / 1024;
+#else
+    t->maxrss = ru->ru_maxrss;
+#endif
+    t->minflt = ru->ru_minflt;
+    t->majflt = ru->ru_majflt;
+    vec_push(timings, t);
+}
+
+static void print_timing(FILE *fp, struct timing *t)
+{
+    fprintf(fp, "  %-24s %-5s %9.3f %9.3f %9.3f %10ld %8ld %6ld\n",
+            t->input, t->stage, t->wall, t->user, t->sys,
+            t->maxrss, t->minflt, t->majflt);
+}
+
+static void print_timing_json(FILE *fp, struct timing *t)
+{
+    fprintf(fp, "{\"input\": ");
+    if (t->input) {
+        fputc('"', fp);
+        for (const char *s = t->input; *s; s++) {
+            if (*s == '"' || *s == '\\')
+                fputc('\\', fp);
+            fputc(*s, fp);
+        }
+        fputc('"', fp);
+    } else {
+        fprintf(fp, "null");
+    }
+    fprintf(fp, ", \"stage\": \"%s\", \"wall\": %.6f, \"user\": %.6f, "
+            "\"sys\": %.6f, \"maxrss_kb\": %ld, \"minflt\": %ld, "
+            "\"majflt\": %ld}\n", t->stage, t->wall, t->user, t->sys,
+            t->maxrss, t->minflt, t->majflt);
+}
+
+/**
+ * One line per subprocess and a total. The total of
+ * the peak RSS is the largest one.
+ */
+static void report_timings(struct timespec start)
+{
+    struct timing total = { .input = NULL, .stage = "total" };
+    FILE *fp = stderr;
+
+    total.wall = elapsed(start);
+    for (int i = 0; i < vec_len(timings); i++) {
+        struct timing *t = vec_at(timings, i);
+        total.user += t->user;
+        total.sys += t->sys;
+        total.maxrss = MAX(total.maxrss, t->maxrss);
+        total.minflt += t->minflt;
+        total.majflt += t->majflt;
+    }
+
+    if (time_file) {
+        if ((fp = fopen(time_file, "a")) == NULL) {
+            fprintf(stderr, "%s: can't write file: %s\n", progname, time_file);
+            return;
+        }
+        for (int i = 0; i < vec_len(timings); i++)
+            print_timing_json(fp, vec_at(timings, i));
+        print_timing_json(fp, &total);
+        fclose(fp);
+        return;
+    }
+
+    fprintf(fp, "  %-24s %-5s %9s %9s %9s %10s %8s %6s\n",
+            "input", "stage", "wall(s)", "user(s)", "sys(s)",
+            "maxrss(KB)", "minflt", "majflt");
+    for (int i = 0; i < vec_len(timings); i++)
+        print_timing(fp, vec_at(timings, i));
+    total.input = "";
+    print_timing(fp, &total);
+}
+
 static int lnk(char *ifiles[], char *ofile, char *options[])
 {
-    return proc(ld[0], compose(ld, ifiles, ofile, options));
+    struct timespec start;
+    struct rusage ru;
+    int ret;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ret = proc_usage(ld[0], compose(ld, ifiles, ofile, options), &ru);
+    add_timing(ofile ? ofile : "a.out", "ld", start, &ru);
+    return ret;
 }
 
-static int assemble(char *ifile, char *ofile)
+// read from stdin if 'ifile' is NULL
+static char **assemble(char *ifile, char *ofile)
 {
-    struct list *ilist = list_append(NULL, ifile);
+    struct list *ilist = ifile ? list_append(NULL, ifile) : NULL;
     char **ifiles = ltoa(&ilist, PERM);
-    return proc(as[0], compose(as, ifiles, ofile, NULL));
+    return compose(as, ifiles, ofile, NULL);
 }
 
-static int translate(char *ifile, char *ofile, char *options[])
+static char **translate(char *ifile, char *ofile, char *options[])
 {
     struct list *ilist = list_append(NULL, ifile);
     char **ifiles = ltoa(&ilist, PERM);
     cc[3] = ofile ? "-o" : NULL;
-    return proc(cc[0], compose(cc, ifiles, ofile, options));
+    return compose(cc, ifiles, ofile, options);
+}
+
+static char **translate_unity(char *ifiles[], char *ofile, char *options[])
+{
+    struct list *ilist = list_append(NULL, "-funity");
+    for (int i = 0; ifiles[i]; i++)
+        ilist = list_append(ilist, ifiles[i]);
+    cc[3] = "-o";
+    return compose(cc, ltoa(&ilist, PERM), ofile, options);
+}
+
+static char **translate_batch(char *manifest, char *options[])
+{
+    struct list *ilist = list_append(NULL, format("-batch=%s", manifest));
+    char **ifiles = ltoa(&ilist, PERM);
+    cc[3] = NULL;
+    return compose(cc, ifiles, NULL, options);
+}
+
+static void add_step(struct job *job, char **argv)
+{
+    assert(job->nsteps < MAX_STEPS);
+    job->steps[job->nsteps++] = argv;
+}
+
+/**
+ * The options of one input. -MD and -MMD need the target
+ * and the file of its rule, they are named after the
+ * object unless -MT or -MF is given.
+ */
+static char **unit_options(char *options[], char *target)
+{
+    struct list *list = NULL;
+
+    if (dep_options[0] == NULL)
+        return options;
+    for (int i = 0; options[i]; i++)
+        list = list_append(list, options[i]);
+    for (int i = 0; dep_options[i]; i++)
+        list = list_append(list, dep_options[i]);
+    if (MDflag && target) {
+        if (!MTflag)
+            list = list_append(list, format("-MT%s", target));
+        if (!MFflag)
+            list = list_append(list, format("-MF%s", resuffix(target, "d")));
+    }
+    return ltoa(&list, PERM);
+}
+
+// cc1 and as connected by a pipe, no .s file is written
+static void add_pipe(struct job *job, char *ifile, char *ofile, char *target)
+{
+    add_step(job, translate(ifile, "-", unit_options(cc_options, target)));
+    add_step(job, assemble(NULL, ofile));
+    job->pipe = true;
+}
+
+/**
+ * Preprocess first, the rest of the steps only run if
+ * the output is not in the cache. 'sfile' is NULL if
+ * 'ofile' is the assembly.
+ */
+static void add_cached(struct job *job, char *ifile, char *sfile, char *ofile,
+                       char *target)
+{
+    job->ifile = ifile;
+    job->ppfile = tempname(tmpdir, resuffix(ifile, "i"));
+    // the rule is written while preprocessing, hit or not
+    add_step(job, translate(ifile, job->ppfile,
+                            unit_options(cpp_options, target)));
+    if (sfile) {
+        add_step(job, translate(ifile, sfile, cc_options));
+        add_step(job, assemble(sfile, ofile));
+    } else {
+        add_step(job, translate(ifile, ofile, cc_options));
+    }
+}
+
+/**
+ * The inputs of a unity group are compiled by the job
+ * of the first one, the other jobs have no steps.
+ */
+static void add_unity(struct job *job, struct list **members, bool pipe)
+{
+    char **ifiles = ltoa(members, PERM);
+    if (pipe) {
+        add_step(job, translate_unity(ifiles, "-", cc_options));
+        add_step(job, assemble(NULL, job->ofile));
+        job->pipe = true;
+    } else {
+        char *sfile = tempname(tmpdir, resuffix(job->ifile, "s"));
+        add_step(job, translate_unity(ifiles, sfile, cc_options));
+        add_step(job, assemble(sfile, job->ofile));
+    }
+}
+
+// after preprocessing, returns true on a cache hit
+static bool lookup_cache(struct job *job)
+{
+    const char *kind = fsuffix(job->ofile);
+    job->key = cache_key(job->ifile, job->ppfile, cc_options, kind ? kind : "");
+    if (job->key && cache_get(job->key, job->ofile)) {
+        // nothing to store
+        job->key = NULL;
+        return true;
+    }
+    return false;
+}
+
+// spread the units over the batches round-robin
+static void add_unit(struct job *job, struct batch *batches, int nbatches,
+                     char *ifile, char *sfile)
+{
+    static int next;
+    struct batch *b = &batches[next++ % nbatches];
+    if (b->fp == NULL) {
+        b->manifest = tempname(tmpdir, "batch.txt");
+        if ((b->fp = fopen(b->manifest, "w")) == NULL)
+            error("Can't write file: %s", b->manifest);
+    }
+    fprintf(b->fp, "%s\t%s\n", ifile, sfile);
+    b->nunits++;
+    job->unit = sfile;
+    job->batch = b;
+}
+
+/**
+ * GNU make passes its jobserver in MAKEFLAGS as
+ * '--jobserver-auth=R,W' (or '--jobserver-fds=R,W'
+ * before make 4.2, 'fifo:PATH' since make 4.4).
+ * Every job beyond the first needs a token from it.
+ */
+static void jobserver_init(void)
+{
+    const char *flags = getenv("MAKEFLAGS");
+    const char *p;
+    int rfd, wfd;
+
+    if (flags == NULL)
+        return;
+    if ((p = strstr(flags, "--jobserver-auth=")))
+        p += strlen("--jobserver-auth=");
+    else if ((p = strstr(flags, "--jobserver-fds=")))
+        p += strlen("--jobserver-fds=");
+    else
+        return;
+
+    if (has_prefix(p, "fifo:")) {
+        const char *end = strchr(p, ' ');
+        char *path = end ? strndup(p + 5, end - p - 5) : strdup(p + 5);
+        jobserver_rfd = open(path, O_RDONLY | O_NONBLOCK);
+        jobserver_wfd = open(path, O_WRONLY);
+    } else if (sscanf(p, "%d,%d", &rfd, &wfd) == 2) {
+        // make only passes the pipe to recursive commands ('+')
+        if (fcntl(rfd, F_GETFD) == -1 || fcntl(wfd, F_GETFD) == -1)
+            return;
+        // a private non-blocking open file description of the pipe
+        jobserver_rfd = open(format("/proc/self/fd/%d", rfd),
+                             O_RDONLY | O_NONBLOCK);
+        jobserver_wfd = wfd;
+    }
+
+    if (jobserver_rfd < 0 || jobserver_wfd < 0)
+        jobserver_rfd = jobserver_wfd = -1;
+}
+
+static int jobserver_acquire(void)
+{
+    unsigned char c;
+    if (read(jobserver_rfd, &c, 1) == 1)
+        return c;
+    return -1;
+}
+
+static void jobserver_release(int token)
+{
+    unsigned char c = token;
+    while (write(jobserver_wfd, &c, 1) == -1 && errno == EINTR)
+        ;
+}
+
+// a request that streamed through stdin or stdout can't be run again
+static bool rerunnable(char **argv)
+{
+    bool ofile = false;
+
+    for (int i = 1; argv[i]; i++) {
+        if (!strcmp(argv[i], "-"))
+            return false;
+        if (!strcmp(argv[i], "-o") && argv[i + 1]) {
+            if (!strcmp(argv[++i], "-"))
+                return false;
+            ofile = true;
+        }
+    }
+    return ofile;
+}
+
+/**
+ * Run cc1 on the compile server, returns its exit
+ * status or -1 if there is no server to take it.
+ */
+static int remote(char **argv)
+{
+    extern char **environ;
+    char cwd[PATH_MAX];
+    struct strbuf *req = strbuf_new();
+    int fds[3] = { 0, 1, 2 };
+    int sock;
+    char *reply;
+
+    if (getcwd(cwd, sizeof(cwd)) == NULL ||
+        (sock = sock_connect(server_path)) < 0)
+        return -1;
+    // the request carries the environment and the terminal
+    if (!sock_peer_ok(sock)) {
+        fprintf(stderr, "%s: %s is not served by this user\n",
+                progname, server_path);
+        close(sock);
+        return -1;
+    }
+
+    strbuf_catn(req, cwd, strlen(cwd) + 1);
+    strbuf_catd(req, length(argv));
+    strbuf_catc(req, 0);
+    for (int i = 0; argv[i]; i++)
+        strbuf_catn(req, argv[i], strlen(argv[i]) + 1);
+    strbuf_catd(req, length(environ));
+    strbuf_catc(req, 0);
+    for (int i = 0; environ[i]; i++)
+        strbuf_catn(req, environ[i], strlen(environ[i]) + 1);
+
+    if (sock_send(sock, req->str, req->len, fds, 3) < 0) {
+        close(sock);
+        return -1;
+    }
+    reply = sock_recv(sock, NULL, NULL, 0);
+    close(sock);
+    if (reply)
+        return atoi(reply);
+    // the worker died, cc1 runs here unless the output is gone
+    if (!rerunnable(argv))
+        return EXIT_FAILURE;
+    fprintf(stderr, "%s: lost the compile server, running cc1\n", progname);
+    return -1;
+}
+
+/**
+ * With --use-server, cc1 runs in a forked child that
+ * talks to the server, or executes cc1 if there is none
+ * or it drops the request.
+ */
+static pid_t spawn_cc1(char **argv, int in, int out)
+{
+    if (server_path == NULL)
+        return spawnfd(argv[0], argv, in, out);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        if ((in != -1 && dup2(in, 0) == -1) ||
+            (out != -1 && dup2(out, 1) == -1))
+            _exit(127);
+        int status = remote(argv);
+        if (status >= 0)
+            _exit(status);
+        execvp(argv[0], argv);
+        _exit(127);
+    } else if (pid < 0) {
+        perror("Can't fork");
+    }
+    return pid;
+}
+
+static pid_t spawn_step(char **argv, int in, int out)
+{
+    if (argv[0] == cc[0])
+        return spawn_cc1(argv, in, out);
+    return spawnfd(argv[0], argv, in, out);
+}
+
+// cc1 writes the assembly to the pipe while as reads it
+static void start_pipe(struct job *job)
+{
+    char **argv1 = job->steps[0];
+    char **argv2 = job->steps[1];
+    int fds[2];
+
+    if (pipe(fds) == -1) {
+        perror("Can't create pipe");
+        job->failed = true;
+        return;
+    }
+    // children only keep the ends dup'ed to stdin/stdout
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+    clock_gettime(CLOCK_MONOTONIC, &job->start);
+    job->start2 = job->start;
+    if ((job->pid2 = spawn_step(argv2, fds[0], -1)) < 0)
+        job->pid2 = 0;
+    else if ((job->pid = spawn_step(argv1, -1, fds[1])) < 0)
+        job->pid = 0;
+    close(fds[0]);
+    close(fds[1]);
+    if (job->pid == 0 || job->pid2 == 0)
+        job->failed = true;
+    job->step = job->nsteps - 1;
+}
+
+static void start_step(struct job *job)
+{
+    char **argv = job->steps[job->step];
+    clock_gettime(CLOCK_MONOTONIC, &job->start);
+    if (job->pipe) {
+        start_pipe(job);
+    } else if ((job->pid = spawn_step(argv, -1, -1)) < 0) {
+        job->pid = 0;
+        job->failed = true;
+    }
+}
+
+static void finish_job(struct job *job)
+{
+    if (job->token >= 0) {
+        jobserver_release(job->token);
+        job->token = -1;
+    }
+    if (job->failed && job->ofile)
+        rmfile(job->ofile);
+    else if (job->key && job->step == job->nsteps)
+        cache_put(job->key, job->ofile);
+}
+
+// returns the job if it is finished
+static struct job *reap(struct job *jobs, int n, pid_t pid, int status,
+                        struct rusage *ru)
+{
+    for (int i = 0; i < n; i++) {
+        struct job *job = &jobs[i];
+        if (job->pid != pid && job->pid2 != pid)
+            continue;
+        if (job->pid == pid) {
+            char **argv = job->steps[job->pipe ? 0 : job->step];
+            add_timing(job->ifile, stage_name(argv), job->start, ru);
+            job->pid = 0;
+        } else {
+            add_timing(job->ifile, stage_name(job->steps[1]), job->start2, ru);
+            job->pid2 = 0;
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            job->failed = true;
+        else if (!job->pipe && ++job->step < job->nsteps &&
+                 !(job->ppfile && job->step == 1 && lookup_cache(job)))
+            start_step(job);
+        if (job->pid || job->pid2)
+            return NULL;
+        finish_job(job);
+        return job;
+    }
+    return NULL;
+}
+
+/**
+ * Run jobs with at most 'njobs' processes in flight.
+ * The driver blocks until one child exits, then reaps
+ * the other finished ones with a non-blocking wait
+ * before refilling the free slots.
+ * Returns the number of failed jobs.
+ */
+static int run_jobs(struct job *jobs, int n)
+{
+    int next = 0;
+    int running = 0;
+    int fails = 0;
+
+    while (next < n || running > 0) {
+        while (next < n && running < njobs) {
+            struct job *job = &jobs[next];
+            if (job->nsteps == 0) {
+                next++;
+                continue;
+            }
+            // the first job runs on the token make gave us
+            if (jobserver_rfd >= 0 && running > 0 &&
+                (job->token = jobserver_acquire()) < 0)
+                break;
+            next++;
+            start_step(job);
+            if (job->pid || job->pid2) {
+                running++;
+            } else {
+                finish_job(job);
+                fails++;
+            }
+        }
+
+        if (running == 0)
+            continue;
+
+        int status;
+        int options = 0;
+        pid_t pid;
+        struct rusage ru;
+        while ((pid = wait4(-1, &status, options, &ru)) != 0) {
+            if (pid < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (options == 0)
+                    die("wait4: %s", strerror(errno));
+                break;
+            }
+            struct job *job = reap(jobs, next, pid, status, &ru);
+            if (job) {
+                running--;
+                if (job->failed)
+                    fails++;
+            }
+            options = WNOHANG;
+        }
+    }
+
+    return fails;
+}
+
+// compile the batched units of 'jobs', returns the number of failed units
+static int run_batches(struct batch *batches, int nbatches,
+                       struct job *jobs, int n)
+{
+    struct job *bjobs = zmalloc(nbatches * sizeof(struct job));
+    int fails = 0;
+
+    for (int i = 0; i < nbatches; i++) {
+        struct batch *b = &batches[i];
+        bjobs[i].token = -1;
+        if (b->fp == NULL)
+            continue;
+        fclose(b->fp);
+        bjobs[i].ifile = format("<%d units>", b->nunits);
+        add_step(&bjobs[i], translate_batch(b->manifest, cc_options));
+    }
+    // no stale output may pass for a compiled unit
+    for (int i = 0; i < n; i++)
+        if (jobs[i].unit)
+            unlink(jobs[i].unit);
+
+    run_jobs(bjobs, nbatches);
+
+    // cc1 renames the output of a unit into place once it
+    // is compiled, so an output is complete even if cc1
+    // crashed on a later unit
+    for (int i = 0; i < n; i++) {
+        struct job *job = &jobs[i];
+        if (job->unit == NULL)
+            continue;
+        unlink(format("%s.tmp", job->unit));
+        if (!fexists(job->unit)) {
+            job->nsteps = 0;
+            job->batch->nfails++;
+            fails++;
+        }
+    }
+    // e.g. it crashed after its last unit
+    for (int i = 0; i < nbatches; i++) {
+        if (bjobs[i].failed && batches[i].nfails == 0) {
+            fprintf(stderr, "%s: cc1 failed on a batch of %d units\n",
+                    progname, batches[i].nunits);
+            fails++;
+        }
+    }
+    return fails;
 }
 
 static void doexit(void)
@@ -201,11 +968,21 @@ int main(int argc, char **argv)
     int fails = 0;
     int partial;
     int ninputs;
-    struct list *objects = NULL;
+    int nobjects = 0;
+    struct job *jobs;
+    char **objects;
+    struct job *leader = NULL;  // first job of the unity group
+    struct list *members = NULL;
+    int nmembers = 0;
+    struct batch *batches = NULL;
+    int nbatches = 0;
+    struct timespec start;
 
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    timings = vec_new();
     atexit(doexit);
     parse_opts(argc, argv);
-    partial = cflag || Sflag || Eflag || ast_dump;
+    partial = cflag || Sflag || Eflag || ast_dump || Mflag;
     ninputs = length(inputs);
 
     if (argc == 1) {
@@ -215,27 +992,71 @@ int main(int argc, char **argv)
         error("no input file.");
     } else if (output && ninputs > 1 && partial) {
         error("cannot specify -o when generating multiple output files");
+    } else if (MFflag && ninputs > 1) {
+        error("cannot specify -MF when generating multiple rules");
     }
 
     if (!(tmpdir = mktmpdir()))
         error("Can't make temporary directory");
 
+    jobserver_init();
+    if (njobs == 0)
+        njobs = jobserver_rfd >= 0 ? ninputs : sysconf(_SC_NPROCESSORS_ONLN);
+    if (njobs <= 0)
+        njobs = 1;
+    // keep the output on stdout in order
+    if ((Eflag || ast_dump || Mflag) && !output)
+        njobs = 1;
+
+    jobs = zmalloc(ninputs * sizeof(struct job));
+    objects = zmalloc((ninputs + 1) * sizeof(char *));
+
+    if (cacheflag)
+        cache_init(cache_dir, cache_size);
+    // the cache, rules and separate outputs need one unit per input
+    if (partial || cacheflag || dep_options[0])
+        unity = 0;
+
+    // one cc1 per slot rather than per .c input
+    if (!Eflag && !ast_dump && !Mflag && !pipeflag && !cacheflag &&
+        !unity && !dep_options[0]) {
+        int nunits = 0;
+        for (int i = 0; i < ninputs; i++) {
+            const char *suffix = fsuffix(inputs[i]);
+            if (suffix && !strcmp(suffix, "c"))
+                nunits++;
+        }
+        if (nunits > 1) {
+            nbatches = nunits < njobs ? nunits : njobs;
+            batches = zmalloc(nbatches * sizeof(struct batch));
+        }
+    }
+
     for (int i = 0; i < ninputs; i++) {
+        struct job *job = &jobs[i];
         char *ifile = inputs[i];
         char *iname = basename(strdup(ifile));
         char *ofile = NULL;
         const char *suffix = fsuffix(ifile);
-        int r = EXIT_SUCCESS;
-        if (Eflag || ast_dump) {
+        job->token = -1;
+        job->ifile = ifile;
+        if (Eflag || ast_dump || Mflag) {
             if (output)
                 ofile = output;
-            r = translate(ifile, ofile, cc_options);
+            add_step(job, translate(ifile, ofile,
+                                    unit_options(cc_options, NULL)));
         } else if (Sflag) {
             if (output)
                 ofile = output;
             else
                 ofile = (char *)resuffix(iname, "s");
-            r = translate(ifile, ofile, cc_options);
+            if (cacheflag && suffix && !strcmp(suffix, "c"))
+                add_cached(job, ifile, NULL, ofile, ofile);
+            else if (batches && suffix && !strcmp(suffix, "c"))
+                add_unit(job, batches, nbatches, ifile, ofile);
+            else
+                add_step(job, translate(ifile, ofile,
+                                        unit_options(cc_options, ofile)));
         } else if (cflag) {
             if (output)
                 ofile = output;
@@ -243,41 +1064,81 @@ int main(int argc, char **argv)
                 ofile = (char *)resuffix(iname, "o");
             // base on suffix
             if (suffix && !strcmp(suffix, "s")) {
-                r = assemble(ifile, ofile);
+                add_step(job, assemble(ifile, ofile));
+            } else if (cacheflag) {
+                char *sfile = tempname(tmpdir, resuffix(ifile, "s"));
+                add_cached(job, ifile, sfile, ofile, ofile);
+            } else if (pipeflag) {
+                add_pipe(job, ifile, ofile, ofile);
             } else {
                 char *sfile = tempname(tmpdir, resuffix(ifile, "s"));
-                if ((r = translate(ifile, sfile, cc_options)) == 0)
-                    r = assemble(sfile, ofile);
+                if (batches)
+                    add_unit(job, batches, nbatches, ifile, sfile);
+                else
+                    add_step(job, translate(ifile, sfile,
+                                            unit_options(cc_options, ofile)));
+                add_step(job, assemble(sfile, ofile));
             }
         } else {
             // base on suffix
             if (suffix && !strcmp(suffix, "s")) {
                 ofile = tempname(tmpdir, resuffix(ifile, "o"));
-                r = assemble(ifile, ofile);
-                objects = list_append(objects, ifile);
-            } else if (suffix && !strcmp(suffix, "c")) {
-                char *sfile = tempname(tmpdir, resuffix(ifile, "s"));
-                if ((r = translate(ifile, sfile, cc_options)) == 0) {
+                add_step(job, assemble(ifile, ofile));
+                objects[nobjects++] = ofile;
+            } else if (suffix && !strcmp(suffix, "c") && unity) {
+                if (leader == NULL) {
+                    leader = job;
                     ofile = tempname(tmpdir, resuffix(ifile, "o"));
-                    r = assemble(sfile, ofile);
-                    objects = list_append(objects, ifile);
+                    leader->ofile = ofile;
+                    objects[nobjects++] = ofile;
+                }
+                members = list_append(members, ifile);
+                if (++nmembers == unity) {
+                    add_unity(leader, &members, pipeflag);
+                    leader = NULL;
+                    nmembers = 0;
+                }
+            } else if (suffix && !strcmp(suffix, "c")) {
+                // the object is temporary, the rule is for 'iname.o'
+                char *target = (char *)resuffix(iname, "o");
+                ofile = tempname(tmpdir, resuffix(ifile, "o"));
+                if (cacheflag) {
+                    char *sfile = tempname(tmpdir, resuffix(ifile, "s"));
+                    add_cached(job, ifile, sfile, ofile, target);
+                } else if (pipeflag) {
+                    add_pipe(job, ifile, ofile, target);
+                } else {
+                    char *sfile = tempname(tmpdir, resuffix(ifile, "s"));
+                    if (batches)
+                        add_unit(job, batches, nbatches, ifile, sfile);
+                    else
+                        add_step(job, translate(ifile, sfile,
+                                                unit_options(cc_options, target)));
+                    add_step(job, assemble(sfile, ofile));
                 }
+                objects[nobjects++] = ofile;
             } else {
-                objects = list_append(objects, ifile);
+                objects[nobjects++] = ifile;
             }
         }
-        if (r == EXIT_FAILURE) {
-            fails++;
-            if (ofile)
-                rmfile(ofile);
-        }
+        job->ofile = ofile;
     }
+    if (leader)
+        add_unity(leader, &members, pipeflag);
 
+    if (batches)
+        fails = run_batches(batches, nbatches, jobs, ninputs);
+    fails += run_jobs(jobs, ninputs);
+    if (cacheflag)
+        cache_report(vflag);
+
+    if (!fails && !partial)
+        // link
+        ret = lnk(objects, output, ld_options);
+    if (timeflag)
+        report_timings(start);
     if (fails)
         error("%lu succeed, %lu failed.", ninputs - fails, fails);
-    else if (!partial)
-        // link
-        ret = lnk(ltoa(&objects, PERM), output, ld_options);
 
     return ret;
 }
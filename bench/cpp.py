@@ -0,0 +1,298 @@
+#!/usr/bin/python
+#-*- coding: utf-8 -*-
+
+# Preprocessor stress benchmark.
+#
+# Generates one unit per stress case and runs 'cc1 -E' on
+# it, reporting KB/s and tokens/s (of the files read, as
+# counted by -fcpp-report) and the peak RSS, which is taken
+# by the bench/maxrss.c program given with -m. The best of
+# RUNS is compared with the baseline, and a case slower or
+# bigger than TOLERANCE percent is flagged as a regression.
+#
+#   bench/cpp.py [-s SCALE] [-r RUNS] [-t TOLERANCE]
+#                [-b BASELINE] [-m MAXRSS] [-R REF] [-u] cc1
+#
+# -R runs the REF cc1 (say, a build of the commit before a
+# change) on the same inputs, alternating with cc1, and
+# compares with it: the way to check a change. Without it
+# the baseline is used, which records the host it was made
+# on and is only checked there; elsewhere it is printed for
+# reference. -u writes the results as the new baseline.
+
+import os
+import sys
+import json
+import time
+import getopt
+import shutil
+import platform
+import tempfile
+import subprocess
+
+BASELINE = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                        'cpp-baseline.json')
+
+
+def write(path, text):
+    with open(path, 'w') as f:
+        f.write(text)
+
+
+def decls(prefix, n):
+    return ''.join('static int %s%d(int a, int b) { return a * %d + b; }\n'
+                   % (prefix, i, i) for i in range(n))
+
+
+# a chain of guarded headers, each included again by all
+# the ones above it
+def gen_guards(d, scale):
+    depth = 400 * scale
+    for i in range(depth):
+        body = ''.join('#include "g%d.h"\n' % j for j in range(i + 1, min(i + 8, depth)))
+        write(os.path.join(d, 'g%d.h' % i),
+              '#ifndef G%d_H\n#define G%d_H\n%s%s#endif\n'
+              % (i, i, body, decls('g%d_' % i, 20)))
+    return ''.join('#include "g%d.h"\n' % i for i in range(depth))
+
+
+# one unit including many small headers
+def gen_fanout(d, scale):
+    n = 1000 * scale
+    for i in range(n):
+        write(os.path.join(d, 'f%d.h' % i),
+              '#pragma once\nstruct f%d { int a, b; char *s; };\n%s'
+              % (i, decls('f%d_' % i, 10)))
+    return ''.join('#include "f%d.h"\n' % i for i in range(n))
+
+
+# a long file with no macros
+def gen_plain(d, scale):
+    return decls('p', 60000 * scale)
+
+
+# argument counting and numbered loops, as in P99
+NLOOP = 64
+
+def p99_header():
+    nums = ', '.join(str(i) for i in range(NLOOP, 0, -1))
+    params = ', '.join('_%d' % i for i in range(1, NLOOP + 1))
+    lines = [
+        '#define P_NARG(...) P_NARG_(__VA_ARGS__, %s)' % nums,
+        '#define P_NARG_(%s, N, ...) N' % params,
+        '#define P_CAT(a, b) P_CAT_(a, b)',
+        '#define P_CAT_(a, b) a ## b',
+        '#define P_FOR(f, ...) P_CAT(P_FOR_, P_NARG(__VA_ARGS__))(f, __VA_ARGS__)',
+        '#define P_FOR_1(f, x) f(x)',
+    ]
+    for i in range(2, NLOOP + 1):
+        lines.append('#define P_FOR_%d(f, x, ...) f(x) P_FOR_%d(f, __VA_ARGS__)'
+                     % (i, i - 1))
+    lines.append('#define DECL(x) int P_CAT(v_, x) = P_NARG(x, x, x);')
+    return '\n'.join(lines) + '\n'
+
+def gen_p99(d, scale):
+    return p99_header() + ''.join(
+        'P_FOR(DECL, %s)\n' % ', '.join('a%d_%d' % (j, i) for j in range(32))
+        for i in range(600 * scale))
+
+
+# pasting and stringizing
+PASTE = '''
+#define CAT(a, b) a ## b
+#define XCAT(a, b) CAT(a, b)
+#define CAT3(a, b, c) a ## b ## c
+#define STR(x) #x
+#define XSTR(x) STR(x)
+#define NAME(p, i) CAT3(p, _, i)
+#define FIELD(p, i) int NAME(p, i); const char *XCAT(NAME(p, i), _name) = XSTR(NAME(p, i));
+#define ROW(p) FIELD(p, 0) FIELD(p, 1) FIELD(p, 2) FIELD(p, 3) \\
+    FIELD(p, 4) FIELD(p, 5) FIELD(p, 6) FIELD(p, 7)
+'''
+
+def gen_paste(d, scale):
+    return PASTE + ''.join('ROW(r%d)\n' % i for i in range(3000 * scale))
+
+
+# mostly skipped groups
+def gen_skip(d, scale):
+    group = ('#if 0\n' +
+             decls('s', 200) +
+             '/* a comment with a "string" */\n#ifdef X\n#define Y 1\n#endif\n' +
+             '%:ifdef X\n%:undef Y\n%:endif\n' +
+             "char c = '\\'';\n" +
+             '%:else\nint live;\n#endif\n')
+    return group * (600 * scale)
+
+
+# long logical lines made of many spliced ones
+def gen_splice(d, scale):
+    line = ''.join('x%d + \\\n' % i for i in range(500)) + '0;\n'
+    return ''.join('int v%d = %s' % (i, line) for i in range(1000 * scale))
+
+
+CASES = [
+    ('guards', gen_guards),
+    ('fanout', gen_fanout),
+    ('plain', gen_plain),
+    ('p99', gen_p99),
+    ('paste', gen_paste),
+    ('skip', gen_skip),
+    ('splice', gen_splice),
+]
+
+
+def host():
+    return '%s/%s' % (platform.node(), platform.machine())
+
+
+# returns (seconds, peak RSS in KB or None) of one run
+def run(cc1, path, maxrss):
+    cmd = [cc1, '-E', path, '-o', os.devnull]
+    if maxrss:
+        cmd.insert(0, maxrss)
+    start = time.time()
+    with open(os.devnull, 'w') as null:
+        p = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=null)
+    elapsed = time.time() - start
+    if p.returncode != 0:
+        sys.stderr.write('%s failed on %s\n' % (cc1, path))
+        sys.exit(1)
+    return elapsed, int(p.stdout) if maxrss else None
+
+
+# bytes and tokens of the files read, from the report
+def count(cc1, path):
+    report = path + '.json'
+    subprocess.run([cc1, '-E', path, '-o', os.devnull,
+                    '-fcpp-report=json=' + report], check=True)
+    # the include tree nests as deep as the headers
+    sys.setrecursionlimit(max(sys.getrecursionlimit(), 10000))
+    with open(report) as f:
+        files = json.load(f)['files']
+    return (sum(f['bytes'] for f in files),
+            sum(f['tokens'] for f in files))
+
+
+# runs each cc1 in turn, so that they see the same load,
+# and returns their results in order
+def measure(cc1s, path, runs, maxrss):
+    nbytes, ntokens = count(cc1s[0], path)
+    best = [None] * len(cc1s)
+    rss = [None] * len(cc1s)
+    for _ in range(runs):
+        for i, cc1 in enumerate(cc1s):
+            elapsed, kb = run(cc1, path, maxrss)
+            best[i] = elapsed if best[i] is None else min(best[i], elapsed)
+            if kb is not None:
+                rss[i] = max(rss[i] or 0, kb)
+    return [{'kb_per_s': int(nbytes / best[i] / 1e3),
+             'tokens_per_s': int(ntokens / best[i]),
+             'rss_kb': rss[i]} for i in range(len(cc1s))]
+
+
+# the rates of one case scale together, so tokens/s, which
+# keeps its precision on the slow cases, stands for both
+def ratio(r, base):
+    return float(r['tokens_per_s']) / base['tokens_per_s']
+
+
+def faster(a, b):
+    return a if a['tokens_per_s'] >= b['tokens_per_s'] else b
+
+
+def compare(name, r, base, tolerance, checked):
+    flags = []
+    if base and not checked:
+        note = '%.2fx' % ratio(r, base)
+    elif base:
+        if ratio(r, base) < 1 - tolerance / 100.0:
+            flags.append('slower (%d KB/s)' % base['kb_per_s'])
+        if (r['rss_kb'] and base.get('rss_kb') and
+            r['rss_kb'] > base['rss_kb'] * (1 + tolerance / 100.0)):
+            flags.append('bigger (%d KB)' % base['rss_kb'])
+        note = '%.2fx %s' % (ratio(r, base), ', '.join(flags) or 'ok')
+    else:
+        note = '-'
+    print('%-8s %9d %12d %10s  %s' % (name, r['kb_per_s'],
+                                      r['tokens_per_s'],
+                                      r['rss_kb'] or '-', note))
+    return not flags
+
+
+def main():
+    scale = 1
+    runs = 5
+    tolerance = 10.0
+    baseline = BASELINE
+    maxrss = None
+    ref = None
+    update = False
+    opts, args = getopt.getopt(sys.argv[1:], 's:r:t:b:m:R:u')
+    for opt, value in opts:
+        if opt == '-s':
+            scale = int(value)
+        elif opt == '-r':
+            runs = int(value)
+        elif opt == '-t':
+            tolerance = float(value)
+        elif opt == '-b':
+            baseline = value
+        elif opt == '-m':
+            maxrss = os.path.abspath(value)
+        elif opt == '-R':
+            ref = value
+        elif opt == '-u':
+            update = True
+    if len(args) != 1:
+        sys.stderr.write('usage: %s [-s SCALE] [-r RUNS] [-t TOLERANCE] '
+                         '[-b BASELINE] [-m MAXRSS] [-R REF] [-u] cc1\n'
+                         % sys.argv[0])
+        sys.exit(1)
+
+    base = {}
+    checked = True
+    if ref:
+        print('baseline: %s, run alongside' % ref)
+    elif not update and os.path.exists(baseline):
+        with open(baseline) as f:
+            base = json.load(f)
+        if base.get('scale') != scale:
+            base = {}
+        elif base.get('host') != host():
+            print('baseline: made on %s, not checked here '
+                  '(-u records one, -R compares with a reference cc1)'
+                  % base.get('host', 'another host'))
+            checked = False
+
+    results = {'scale': scale, 'host': host()}
+    ok = True
+    d = tempfile.mkdtemp()
+    try:
+        print('%-8s %9s %12s %10s  %s' % ('case', 'KB/s', 'tokens/s',
+                                          'RSS(KB)', 'baseline'))
+        for name, gen in CASES:
+            path = os.path.join(d, name + '.c')
+            write(path, gen(d, scale))
+            cc1s = [args[0], ref] if ref else [args[0]]
+            r = measure(cc1s, path, runs, maxrss)
+            b = r[1] if ref else base.get(name)
+            if checked and b and ratio(r[0], b) < 1 - tolerance / 100.0:
+                # measure again before calling it a regression
+                again = measure(cc1s, path, runs, maxrss)
+                r = [faster(x, y) for x, y in zip(r, again)]
+                b = r[1] if ref else b
+            results[name] = r[0]
+            ok &= compare(name, r[0], b, tolerance, checked)
+    finally:
+        shutil.rmtree(d)
+
+    if update:
+        with open(baseline, 'w') as f:
+            json.dump(results, f, indent=2, sort_keys=True)
+            f.write('\n')
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()
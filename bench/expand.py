@@ -0,0 +1,83 @@
+#!/usr/bin/python
+#-*- coding: utf-8 -*-
+
+# Macro expansion benchmark.
+#
+# Generates an expansion-heavy unit, in the style of the
+# preprocessor metaprogramming libraries: arguments used
+# many times, nested invocations, token pasting and
+# variable arguments. Then times 'cc1 -E' on it.
+#
+#   bench/expand.py [-n LINES] [-r RUNS] cc1 [cc1 ...]
+
+import os
+import sys
+import time
+import getopt
+import tempfile
+import subprocess
+
+HEADER = '''
+#define CAT(a, b) CAT_(a, b)
+#define CAT_(a, b) a ## b
+#define FIRST(a, ...) a
+#define REST(a, ...) __VA_ARGS__
+#define SQ(x) ((x) * (x))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define USE4(x) x, x, x, x
+#define USE16(x) USE4(x), USE4(x), USE4(x), USE4(x)
+#define R1(f, x) f(x)
+#define R2(f, x) R1(f, x) R1(f, CAT(x, _))
+#define R4(f, x) R2(f, x) R2(f, CAT(x, _))
+#define R8(f, x) R4(f, x) R4(f, CAT(x, _))
+#define DECL(x) int x = MAX(SQ(FIRST(1, 2, 3)), SQ(REST(1, 2)));
+#define ARR(x) int CAT(x, _a)[] = { USE16(SQ(MAX(x ## 1, 2))) };
+'''
+
+def generate(path, lines):
+    with open(path, 'w') as f:
+        f.write(HEADER)
+        for i in range(lines):
+            f.write('R8(DECL, v%d)\n' % i)
+            f.write('ARR(w%d)\n' % i)
+
+
+def run(cc1, path, runs):
+    best = None
+    for _ in range(runs):
+        start = time.time()
+        subprocess.check_call([cc1, '-E', path, '-o', os.devnull])
+        elapsed = time.time() - start
+        if best is None or elapsed < best:
+            best = elapsed
+    return best
+
+
+def main():
+    lines = 2000
+    runs = 3
+    opts, args = getopt.getopt(sys.argv[1:], 'n:r:')
+    for opt, value in opts:
+        if opt == '-n':
+            lines = int(value)
+        elif opt == '-r':
+            runs = int(value)
+    if not args:
+        sys.stderr.write('usage: %s [-n LINES] [-r RUNS] cc1 [cc1 ...]\n'
+                         % sys.argv[0])
+        sys.exit(1)
+
+    fd, path = tempfile.mkstemp(suffix='.c')
+    os.close(fd)
+    try:
+        generate(path, lines)
+        print('%s: %d bytes' % (os.path.basename(path),
+                                os.path.getsize(path)))
+        for cc1 in args:
+            print('%-30s %.3fs' % (cc1, run(cc1, path, runs)))
+    finally:
+        os.unlink(path)
+
+
+if __name__ == '__main__':
+    main()
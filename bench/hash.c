@@ -0,0 +1,295 @@
+/**
+ * String hash benchmark.
+ *
+ *   hash [-r RUNS] file [file ...]
+ *
+ * The corpus is the identifiers of the files, which are
+ * meant to be preprocessed sources (make bench-hash uses
+ * those of the compiler), plus a synthetic set of numbered
+ * names, which defeats hashes that mix only upward. Each
+ * hash is timed over the identifiers and over long strings,
+ * and scored on the distinct ones as the tables use it:
+ * masked to a power of two.
+ *
+ *   collisions  distinct names with the same 32-bit hash
+ *   chain       sum of b(b+1)/2 over the buckets at a load
+ *               of 1/2 to 1, divided by its value for a
+ *               uniform hash (1.00 is ideal)
+ *   probes      mean linear probes of a successful search
+ *               at load 3/4, the growth point of strtab
+ *
+ * The run fails if strnhash, on either set, has more than
+ * 2 + 4 n(n-1)/2^33 collisions (four times the birthday
+ * expectation for n names, plus slack for small sets), a
+ * chain above 1.10, or probes above 3.00 (20% over the 2.5
+ * of a uniform hash). fnv1a is only there to compare with.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <time.h>
+#include "libutils.h"
+
+#define FNV32_BASIS ((unsigned int) 0x811c9dc5)
+#define FNV32_PRIME ((unsigned int) 0x01000193)
+
+#define MAX_CHAIN   1.10
+#define MAX_PROBES  3.00
+
+// the byte-at-a-time FNV-1a strnhash() used to be
+static unsigned int fnv1a(const char *s, size_t len)
+{
+    unsigned int hash = FNV32_BASIS;
+    for (size_t i = 0; i < len; i++, s++) {
+        hash ^= *s;
+        hash *= FNV32_PRIME;
+    }
+    return hash;
+}
+
+static struct {
+    const char *name;
+    unsigned int (*fn) (const char *, size_t);
+    bool checked;
+} hashes[] = {
+    { "fnv1a", fnv1a, false },
+    { "strnhash", strnhash, true },
+};
+
+static volatile unsigned int sink;
+
+struct name {
+    const char *str;
+    size_t len;
+};
+
+struct corpus {
+    struct name *names;
+    size_t n, cap;
+    size_t bytes;
+};
+
+static void add(struct corpus *c, const char *str, size_t len)
+{
+    if (c->n == c->cap) {
+        c->cap = c->cap ? c->cap * 2 : 1024;
+        c->names = xrealloc(c->names, c->cap * sizeof(struct name));
+    }
+    c->names[c->n].str = str;
+    c->names[c->n].len = len;
+    c->n++;
+    c->bytes += len;
+}
+
+static void scan(struct corpus *c, const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    char *buf, *p;
+    long size;
+
+    if (fp == NULL) {
+        fprintf(stderr, "can't read file: %s\n", path);
+        exit(1);
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    buf = xmalloc(size + 1);
+    size = fread(buf, 1, size, fp);
+    buf[size] = '\0';
+    fclose(fp);
+
+    for (p = buf; *p; ) {
+        if (*p == '_' || isalpha((unsigned char)*p)) {
+            char *s = p;
+            while (*p == '_' || isalnum((unsigned char)*p))
+                p++;
+            add(c, s, p - s);
+        } else if (isdigit((unsigned char)*p)) {
+            while (isalnum((unsigned char)*p) || *p == '.')
+                p++;
+        } else if (*p == '"' || *p == '\'') {
+            // skip literals, their words are not identifiers
+            char q = *p++;
+            while (*p && *p != q && *p != '\n')
+                if (*p++ == '\\' && *p)
+                    p++;
+            if (*p == q)
+                p++;
+        } else {
+            p++;
+        }
+    }
+}
+
+static int cmpname(const void *a, const void *b)
+{
+    const struct name *x = a, *y = b;
+    size_t len = x->len < y->len ? x->len : y->len;
+    int r = memcmp(x->str, y->str, len);
+    if (r)
+        return r;
+    return x->len < y->len ? -1 : x->len > y->len;
+}
+
+static void distinct(struct corpus *to, const struct corpus *from)
+{
+    struct name *v = xmalloc(from->n * sizeof(struct name));
+
+    memcpy(v, from->names, from->n * sizeof(struct name));
+    qsort(v, from->n, sizeof(struct name), cmpname);
+    for (size_t i = 0; i < from->n; i++)
+        if (i == 0 || cmpname(&v[i - 1], &v[i]))
+            add(to, v[i].str, v[i].len);
+    free(v);
+}
+
+static int cmpuint(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+    return x < y ? -1 : x > y;
+}
+
+// returns the number of thresholds exceeded
+static int quality(const char *title, const struct corpus *c)
+{
+    size_t n = c->n, m, collisions = 0;
+    size_t max_collisions = 2 + 4.0 * n * (n - 1) / 8589934592.0;
+    int fails = 0;
+    unsigned int *h = xmalloc(n * sizeof(unsigned int));
+    unsigned int *b;
+    char *used;
+
+    printf("\n%s: %zu distinct names\n", title, n);
+    printf("%-10s %10s %8s %8s\n", "hash", "collisions", "chain", "probes");
+    for (unsigned int k = 0; k < ARRAY_SIZE(hashes); k++) {
+        double sum = 0, chain, probes = 0;
+        const char *why = NULL;
+
+        for (size_t i = 0; i < n; i++)
+            h[i] = hashes[k].fn(c->names[i].str, c->names[i].len);
+
+        // chain: n names in the next power of two buckets
+        for (m = 1; m < n; m <<= 1)
+            ;
+        b = xcalloc(m, sizeof(unsigned int));
+        for (size_t i = 0; i < n; i++)
+            b[h[i] & (m - 1)]++;
+        for (size_t i = 0; i < m; i++)
+            sum += b[i] * (b[i] + 1.0) / 2;
+        free(b);
+        chain = sum / (n / (2.0 * m) * (n + 2.0 * m - 1));
+
+        // probes: the first 3/4 m names in m slots
+        for (m = 1; m * 3 / 4 < n; m <<= 1)
+            ;
+        m >>= 1;
+        used = xcalloc(m, 1);
+        for (size_t i = 0; i < m * 3 / 4; i++) {
+            size_t j = h[i] & (m - 1);
+            for (probes++; used[j]; probes++)
+                j = (j + 1) & (m - 1);
+            used[j] = 1;
+        }
+        free(used);
+
+        qsort(h, n, sizeof(unsigned int), cmpuint);
+        collisions = 0;
+        for (size_t i = 1; i < n; i++)
+            if (h[i] == h[i - 1])
+                collisions++;
+
+        probes /= m * 3 / 4;
+
+        if (collisions > max_collisions)
+            why = "collisions";
+        else if (chain > MAX_CHAIN)
+            why = "chain";
+        else if (probes > MAX_PROBES)
+            why = "probes";
+        printf("%-10s %10zu %8.2f %8.2f", hashes[k].name, collisions,
+               chain, probes);
+        if (hashes[k].checked && why) {
+            printf("  FAIL: %s", why);
+            fails++;
+        }
+        printf("\n");
+    }
+    printf("%-10s %10zu %8.2f %8.2f  (limits)\n", "", max_collisions,
+           MAX_CHAIN, MAX_PROBES);
+    printf("%-10s %10s %8s %8.2f\n", "(uniform)", "", "1.00", 2.5);
+    free(h);
+    return fails;
+}
+
+static double speed(unsigned int (*fn) (const char *, size_t),
+                    const struct corpus *c, int runs)
+{
+    double best = 0;
+
+    for (int r = 0; r < runs; r++) {
+        unsigned int x = 0;
+        clock_t start = clock();
+        size_t bytes = 0;
+        double t;
+
+        do {
+            for (size_t i = 0; i < c->n; i++)
+                x ^= fn(c->names[i].str, c->names[i].len);
+            bytes += c->bytes;
+        } while (bytes < 64 * 1024 * 1024);
+        t = (double)(clock() - start) / CLOCKS_PER_SEC;
+        if (t > 0 && (best == 0 || bytes / t > best))
+            best = bytes / t;
+        sink = x;
+    }
+    return best / (1024 * 1024);
+}
+
+int main(int argc, char *argv[])
+{
+    struct corpus all = { 0 }, idents = { 0 }, numbered = { 0 };
+    struct corpus lines = { 0 };
+    static char longbuf[4096];
+    int runs = 3;
+    int fails = 0;
+    int i = 1;
+
+    if (i + 1 < argc && !strcmp(argv[i], "-r")) {
+        runs = atoi(argv[i + 1]);
+        i += 2;
+    }
+    if (i == argc) {
+        fprintf(stderr, "usage: %s [-r RUNS] file [file ...]\n", argv[0]);
+        return 1;
+    }
+    for (; i < argc; i++)
+        scan(&all, argv[i]);
+    if (all.n == 0) {
+        fprintf(stderr, "no identifiers\n");
+        return 1;
+    }
+    distinct(&idents, &all);
+
+    for (i = 0; i < 100000; i++) {
+        char *s = format("name%d", i);
+        add(&numbered, s, strlen(s));
+    }
+    for (i = 0; i < (int)sizeof(longbuf); i++)
+        longbuf[i] = 'a' + i * 7 % 26;
+    for (i = 0; i < 64; i++)
+        add(&lines, longbuf + i, sizeof(longbuf) - 64);
+
+    printf("corpus: %zu identifiers, %zu distinct, %.1f bytes on average\n",
+           all.n, idents.n, (double)all.bytes / all.n);
+    printf("\n%-10s %12s %12s\n", "hash", "idents MB/s", "4KB MB/s");
+    for (unsigned int k = 0; k < ARRAY_SIZE(hashes); k++)
+        printf("%-10s %12.0f %12.0f\n", hashes[k].name,
+               speed(hashes[k].fn, &all, runs),
+               speed(hashes[k].fn, &lines, runs));
+
+    fails += quality("identifiers", &idents);
+    fails += quality("numbered", &numbered);
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,91 @@
+#!/usr/bin/python
+#-*- coding: utf-8 -*-
+
+# Lexing benchmark.
+#
+# Generates a unit of declarations only, dense in keywords
+# and identifiers and with no macros, so that most of the
+# time goes to handing tokens to the parser rather than to
+# the preprocessor or the code generator. Then times
+# 'cc1 -S' on it and prints tokens/s.
+#
+#   bench/lex.py [-n LINES] [-r RUNS] cc1 [cc1 ...]
+
+import os
+import sys
+import time
+import getopt
+import tempfile
+import subprocess
+
+DECLS = [
+    'extern const unsigned long int %s_a(register int x, volatile char *y);',
+    'extern signed short %s_b(unsigned char c, double d, float f);',
+    'typedef struct %s_s { int first; long second; char *third; } %s_t;',
+    'extern %s_t *%s_c(const %s_t *self, unsigned int flags, void *data);',
+    'union %s_u { long long value; double real; unsigned char bytes[8]; };',
+    'enum %s_e { %s_none, %s_some, %s_many, %s_all };',
+    'extern _Bool %s_d(enum %s_e kind, union %s_u *out, const char *name);',
+]
+
+
+def generate(path, lines):
+    ntokens = 0
+    with open(path, 'w') as f:
+        for i in range(lines):
+            name = 'n%d' % i
+            for d in DECLS:
+                line = d.replace('%s', name)
+                f.write(line + '\n')
+    # a rough count: words and punctuators
+    with open(path) as f:
+        for line in f:
+            for c in '(){}[];,*':
+                line = line.replace(c, ' %s ' % c)
+            ntokens += len(line.split())
+    return ntokens
+
+
+def run(cc1, path, runs):
+    best = None
+    for _ in range(runs):
+        start = time.time()
+        with open(os.devnull, 'w') as null:
+            subprocess.check_call([cc1, '-S', path, '-o', os.devnull],
+                                  stderr=null)
+        elapsed = time.time() - start
+        if best is None or elapsed < best:
+            best = elapsed
+    return best
+
+
+def main():
+    lines = 4000
+    runs = 5
+    opts, args = getopt.getopt(sys.argv[1:], 'n:r:')
+    for opt, value in opts:
+        if opt == '-n':
+            lines = int(value)
+        elif opt == '-r':
+            runs = int(value)
+    if not args:
+        sys.stderr.write('usage: %s [-n LINES] [-r RUNS] cc1 [cc1 ...]\n'
+                         % sys.argv[0])
+        sys.exit(1)
+
+    fd, path = tempfile.mkstemp(suffix='.c')
+    os.close(fd)
+    try:
+        ntokens = generate(path, lines)
+        print('%s: %d bytes, %d tokens' % (os.path.basename(path),
+                                           os.path.getsize(path), ntokens))
+        for cc1 in args:
+            elapsed = run(cc1, path, runs)
+            print('%-30s %.3fs %12.0f tokens/s'
+                  % (cc1, elapsed, ntokens / elapsed))
+    finally:
+        os.unlink(path)
+
+
+if __name__ == '__main__':
+    main()
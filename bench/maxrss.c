@@ -0,0 +1,50 @@
+/**
+ * Runs a command and prints its peak RSS in KB.
+ *
+ *   maxrss cmd [arg ...]
+ *
+ * A child inherits the peak of the process it was forked
+ * from, so the RSS of a command run by the benchmark
+ * scripts can't be smaller than that of the interpreter.
+ * Forked from this one it can.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+int main(int argc, char *argv[])
+{
+    struct rusage ru;
+    pid_t pid;
+    int status;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s cmd [arg ...]\n", argv[0]);
+        return 1;
+    }
+    if ((pid = fork()) < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0) {
+        execvp(argv[1], argv + 1);
+        perror(argv[1]);
+        _exit(127);
+    }
+    if (wait4(pid, &status, 0, &ru) < 0) {
+        perror("wait4");
+        return 1;
+    }
+    // KB on Linux, bytes on Darwin
+#ifdef __APPLE__
+    printf("%ld\n", (long)ru.ru_maxrss / 1024);
+#else
+    printf("%ld\n", (long)ru.ru_maxrss);
+#endif
+    if (WIFEXITED(status))
+        return WEXITSTATUS(status);
+    return 128 + WTERMSIG(status);
+}
@@ -0,0 +1,137 @@
+/* Auto-generated by mkkw from token.def. */
+
+#define KW_MINLEN  2
+#define KW_MAXLEN  10
+#define KW_HASH(s, len) \
+    (((len) * 1 + (s)[0] * 10 + (s)[(len) - 1] * 3) & 127)
+
+static const struct keyword kwtab[128] = {
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { "case", 4, CASE },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { "continue", 8, CONTINUE },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { "break", 5, BREAK },
+    { "auto", 4, AUTO },
+    { NULL, 0, 0 },
+    { "double", 6, DOUBLE },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { "else", 4, ELSE },
+    { "_Complex", 8, _COMPLEX },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { "_Imaginary", 10, _IMAGINARY },
+    { NULL, 0, 0 },
+    { "static", 6, STATIC },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { "signed", 6, SIGNED },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { "sizeof", 6, SIZEOF },
+    { "do", 2, DO },
+    { "char", 4, CHAR },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { "switch", 6, SWITCH },
+    { "enum", 4, ENUM },
+    { NULL, 0, 0 },
+    { "const", 5, CONST },
+    { NULL, 0, 0 },
+    { "typedef", 7, TYPEDEF },
+    { "extern", 6, EXTERN },
+    { NULL, 0, 0 },
+    { "return", 6, RETURN },
+    { NULL, 0, 0 },
+    { "unsigned", 8, UNSIGNED },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { "default", 7, DEFAULT },
+    { "void", 4, VOID },
+    { NULL, 0, 0 },
+    { "if", 2, IF },
+    { "inline", 6, INLINE },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { "register", 8, REGISTER },
+    { "volatile", 8, VOLATILE },
+    { NULL, 0, 0 },
+    { "for", 3, FOR },
+    { NULL, 0, 0 },
+    { "goto", 4, GOTO },
+    { "restrict", 8, RESTRICT },
+    { NULL, 0, 0 },
+    { "while", 5, WHILE },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { "float", 5, FLOAT },
+    { NULL, 0, 0 },
+    { "short", 5, SHORT },
+    { "struct", 6, STRUCT },
+    { "union", 5, UNION },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { "long", 4, LONG },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { "int", 3, INT },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { NULL, 0, 0 },
+    { "_Bool", 5, _BOOL },
+};
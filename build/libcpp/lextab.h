@@ -0,0 +1,216 @@
+/* Auto-generated by mklex from token.def. */
+
+enum {
+    LC_OTHER, LC_NEWLINE, LC_SPACE, LC_SINGLE, LC_PUNCT, LC_DOT,
+    LC_SLASH, LC_DIGIT, LC_IDENT, LC_WIDE, LC_CHAR, LC_STRING
+};
+
+static const unsigned char lex_class[256] = {
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_SPACE, LC_NEWLINE, LC_SPACE,
+    LC_SPACE, LC_SPACE, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_SPACE, LC_PUNCT, LC_STRING, LC_PUNCT,
+    LC_OTHER, LC_PUNCT, LC_PUNCT, LC_CHAR,
+    LC_SINGLE, LC_SINGLE, LC_PUNCT, LC_PUNCT,
+    LC_SINGLE, LC_PUNCT, LC_DOT, LC_SLASH,
+    LC_DIGIT, LC_DIGIT, LC_DIGIT, LC_DIGIT,
+    LC_DIGIT, LC_DIGIT, LC_DIGIT, LC_DIGIT,
+    LC_DIGIT, LC_DIGIT, LC_PUNCT, LC_SINGLE,
+    LC_PUNCT, LC_PUNCT, LC_PUNCT, LC_SINGLE,
+    LC_OTHER, LC_IDENT, LC_IDENT, LC_IDENT,
+    LC_IDENT, LC_IDENT, LC_IDENT, LC_IDENT,
+    LC_IDENT, LC_IDENT, LC_IDENT, LC_IDENT,
+    LC_WIDE, LC_IDENT, LC_IDENT, LC_IDENT,
+    LC_IDENT, LC_IDENT, LC_IDENT, LC_IDENT,
+    LC_IDENT, LC_IDENT, LC_IDENT, LC_IDENT,
+    LC_IDENT, LC_IDENT, LC_IDENT, LC_SINGLE,
+    LC_OTHER, LC_SINGLE, LC_PUNCT, LC_IDENT,
+    LC_OTHER, LC_IDENT, LC_IDENT, LC_IDENT,
+    LC_IDENT, LC_IDENT, LC_IDENT, LC_IDENT,
+    LC_IDENT, LC_IDENT, LC_IDENT, LC_IDENT,
+    LC_IDENT, LC_IDENT, LC_IDENT, LC_IDENT,
+    LC_IDENT, LC_IDENT, LC_IDENT, LC_IDENT,
+    LC_IDENT, LC_IDENT, LC_IDENT, LC_IDENT,
+    LC_IDENT, LC_IDENT, LC_IDENT, LC_SINGLE,
+    LC_PUNCT, LC_SINGLE, LC_SINGLE, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+    LC_OTHER, LC_OTHER, LC_OTHER, LC_OTHER,
+};
+
+#define LEX_START  1
+
+static const unsigned char lex_pclass[256] = {
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0, 13,  0, 25,  0, 15,  8,  0,  3,  4,  9, 10, 24, 11,  7, 14,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 21, 22, 16, 23, 17, 20,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  2, 18,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  5, 19,  6, 12,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+};
+
+static const unsigned char lex_next[58][26] = {
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 48, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 46, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 33, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 27, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 43, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 28, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 44, 0, 0, 0, 0, 0, 45, 0, 0, 0, 0, 0, 29, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 42, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 30, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 54, 0, 0, 0, 55, 0, 31, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 53, 35, 0, 0, 0, 0, 51, 0, 40, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 37, 0, 0, 0, 0, 0, 39, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 32, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 47, 0, 0, 0, 34, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 52, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 41, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 50 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 36, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 38, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 49, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 56, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 57, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+
+static const unsigned short lex_accept[58] = {
+    0,
+    0,
+    '[',
+    ']',
+    '(',
+    ')',
+    '{',
+    '}',
+    '.',
+    '&',
+    '*',
+    '+',
+    '-',
+    '~',
+    '!',
+    '/',
+    '%',
+    '<',
+    '>',
+    '^',
+    '|',
+    '?',
+    ':',
+    ';',
+    '=',
+    ',',
+    '#',
+    MULEQ,
+    ADDEQ,
+    MINUSEQ,
+    DIVEQ,
+    MODEQ,
+    XOREQ,
+    BANDEQ,
+    BOREQ,
+    LSHIFT,
+    LSHIFTEQ,
+    RSHIFT,
+    RSHIFTEQ,
+    GEQ,
+    LEQ,
+    EQL,
+    NEQ,
+    INCR,
+    DECR,
+    DEREF,
+    ANDAND,
+    OROR,
+    0,
+    ELLIPSIS,
+    SHARPSHARP,
+    '[',
+    ']',
+    '{',
+    '}',
+    '#',
+    0,
+    SHARPSHARP,
+};
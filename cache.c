@@ -0,0 +1,305 @@
+/*
+ * compilation cache of the driver
+ */
+#include "config.h"
+#include "compat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/file.h>
+#include <sys/time.h>
+#include "libutils.h"
+#include "cache.h"
+
+/**
+ * The cache maps a key to a .s or .o file:
+ *
+ *   DIR/ab/cdef...     entry, 'abcdef...' is the key
+ *   DIR/stats          hits misses evictions size
+ *
+ * The key is the SHA-256 of everything the output
+ * depends on: the preprocessed source, the cc1 options,
+ * the version and the target. Entries are written to a
+ * temporary file and renamed into place, so concurrent
+ * builds never see a partial one. A hit touches the
+ * entry, and the least recently used entries are
+ * removed once the size goes over the limit.
+ */
+
+#ifdef CONFIG_LINUX
+#define TARGET_OS  "linux"
+#elif defined (CONFIG_DARWIN)
+#define TARGET_OS  "darwin"
+#endif
+#define TARGET_ARCH  "x86_64"
+
+struct centry {
+    char *path;
+    time_t mtime;
+    long size;
+};
+
+static const char *cache_dir;
+static long max_size;
+static long hits, misses, evictions;
+// totals of the stats file
+static long total_hits, total_misses, total_evictions, total_size;
+
+void cache_init(const char *dir, long size)
+{
+    if (dir == NULL) {
+        const char *home = getenv("HOME");
+        if (home)
+            dir = join(home, ".cache/9cc");
+        else
+            dir = format("/tmp/9cc-cache-%d", (int)getuid());
+    }
+    cache_dir = dir;
+    max_size = size;
+}
+
+static bool mkdirs(const char *path)
+{
+    char *p = strdup(path);
+    for (char *s = p + 1; *s; s++) {
+        if (*s == '/') {
+            *s = 0;
+            mkdir(p, 0777);
+            *s = '/';
+        }
+    }
+    free(p);
+    return mkdir(path, 0777) == 0 || errno == EEXIST;
+}
+
+static bool copy_file(const char *src, const char *dst)
+{
+    char buf[8192];
+    ssize_t n;
+    int in, out;
+    bool ok = true;
+
+    if ((in = open(src, O_RDONLY)) < 0)
+        return false;
+    if ((out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0) {
+        close(in);
+        return false;
+    }
+    while ((n = read(in, buf, sizeof(buf))) > 0) {
+        if (write(out, buf, n) != n) {
+            ok = false;
+            break;
+        }
+    }
+    if (n < 0)
+        ok = false;
+    close(in);
+    if (close(out) < 0)
+        ok = false;
+    return ok;
+}
+
+static bool hash_file(struct sha256 *ctx, const char *path)
+{
+    char buf[8192];
+    ssize_t n;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+        return false;
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+        sha256_update(ctx, buf, n);
+    close(fd);
+    return n == 0;
+}
+
+static void hash_string(struct sha256 *ctx, const char *s)
+{
+    sha256_update(ctx, s, strlen(s) + 1);
+}
+
+/**
+ * 'ifile' is hashed by name only since cc1 emits it in
+ * '.file', its contents are in 'ppfile'.
+ * 'kind' is the suffix of the output ("s" or "o").
+ */
+char *cache_key(const char *ifile, const char *ppfile,
+                char *options[], const char *kind)
+{
+    struct sha256 ctx;
+
+    sha256_init(&ctx);
+    hash_string(&ctx, VERSION);
+    hash_string(&ctx, TARGET_OS);
+    hash_string(&ctx, TARGET_ARCH);
+    hash_string(&ctx, kind);
+    hash_string(&ctx, basename(strdup(ifile)));
+    for (int i = 0; options[i]; i++)
+        hash_string(&ctx, options[i]);
+    if (!hash_file(&ctx, ppfile))
+        return NULL;
+    return sha256_hex(&ctx);
+}
+
+static const char *entry_path(const char *key)
+{
+    return format("%s/%.2s/%s", cache_dir, key, key + 2);
+}
+
+bool cache_get(const char *key, const char *ofile)
+{
+    const char *path = entry_path(key);
+
+    if (!copy_file(path, ofile)) {
+        misses++;
+        return false;
+    }
+    // most recently used
+    utimes(path, NULL);
+    hits++;
+    return true;
+}
+
+static int cmp_entry(const void *a, const void *b)
+{
+    const struct centry *e1 = a;
+    const struct centry *e2 = b;
+    if (e1->mtime != e2->mtime)
+        return e1->mtime < e2->mtime ? -1 : 1;
+    return 0;
+}
+
+/**
+ * Remove the least recently used entries until 90% of
+ * the limit is left. Returns the size of the cache.
+ */
+static long evict(void)
+{
+    struct vector *v = vec_new();
+    long size = 0;
+    DIR *top;
+    struct dirent *d1;
+
+    if ((top = opendir(cache_dir)) == NULL)
+        return 0;
+    while ((d1 = readdir(top))) {
+        // only the 'ab' directories, never '..'
+        if (strlen(d1->d_name) != 2 || !isxdigit(d1->d_name[0]) ||
+            !isxdigit(d1->d_name[1]))
+            continue;
+        const char *sub = join(cache_dir, d1->d_name);
+        DIR *dir = opendir(sub);
+        struct dirent *d2;
+        if (dir == NULL)
+            continue;
+        while ((d2 = readdir(dir))) {
+            struct stat st;
+            const char *path;
+            // being written by another build
+            if (d2->d_name[0] == '.' || has_prefix(d2->d_name, "tmp."))
+                continue;
+            path = join(sub, d2->d_name);
+            if (stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+                continue;
+            struct centry *e = xmalloc(sizeof(struct centry));
+            e->path = (char *)path;
+            e->mtime = st.st_mtime;
+            e->size = st.st_size;
+            size += e->size;
+            vec_push(v, e);
+        }
+        closedir(dir);
+    }
+    closedir(top);
+
+    if (size > max_size) {
+        int n = vec_len(v);
+        struct centry *entries = xmalloc(n * sizeof(struct centry));
+        for (int i = 0; i < n; i++)
+            entries[i] = *(struct centry *)vec_at(v, i);
+        qsort(entries, n, sizeof(struct centry), cmp_entry);
+        for (int i = 0; i < n && size > max_size / 10 * 9; i++) {
+            if (unlink(entries[i].path) == 0) {
+                size -= entries[i].size;
+                evictions++;
+            }
+        }
+    }
+    return size;
+}
+
+/**
+ * Add the counters of this run to the stats file, and
+ * evict entries if 'grow' makes the cache too large.
+ */
+static void update_stats(long grow)
+{
+    const char *path = join(cache_dir, "stats");
+    FILE *fp;
+    int fd;
+
+    if ((fd = open(path, O_RDWR | O_CREAT, 0666)) < 0)
+        return;
+    flock(fd, LOCK_EX);
+    fp = fdopen(fd, "r+");
+    total_hits = total_misses = total_evictions = total_size = 0;
+    if (fscanf(fp, "%ld %ld %ld %ld", &total_hits, &total_misses,
+               &total_evictions, &total_size) != 4)
+        // the scan already sees the new entry
+        total_size = evict() - grow;
+
+    total_size += grow;
+    if (total_size > max_size) {
+        long n = evictions;
+        total_size = evict();
+        total_evictions += evictions - n;
+    }
+    if (grow == 0) {
+        total_hits += hits;
+        total_misses += misses;
+    }
+
+    rewind(fp);
+    fprintf(fp, "%ld %ld %ld %ld\n", total_hits, total_misses,
+            total_evictions, total_size);
+    fflush(fp);
+    ftruncate(fd, ftell(fp));
+    // closing releases the lock
+    fclose(fp);
+}
+
+void cache_put(const char *key, const char *ofile)
+{
+    static long seq;
+    const char *dir = format("%s/%.2s", cache_dir, key);
+    const char *tmp = format("%s/tmp.%d.%ld", dir, (int)getpid(), seq++);
+    long size = fsize(ofile);
+
+    if (size < 0 || !mkdirs(dir))
+        return;
+    if (!copy_file(ofile, tmp) || rename(tmp, entry_path(key)) < 0) {
+        unlink(tmp);
+        return;
+    }
+    update_stats(size);
+}
+
+void cache_report(bool verbose)
+{
+    if (hits == 0 && misses == 0)
+        return;
+    if (!mkdirs(cache_dir))
+        return;
+    update_stats(0);
+    if (!verbose)
+        return;
+    fprintf(stderr, "cache: %ld hits, %ld misses, %ld evictions "
+            "(total %ld hits, %ld misses, %ld evictions)\n",
+            hits, misses, evictions,
+            total_hits, total_misses, total_evictions);
+    fprintf(stderr, "cache: %s, %ld of %ld bytes\n",
+            cache_dir, total_size, max_size);
+}
@@ -0,0 +1,11 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+extern void cache_init(const char *dir, long max_size);
+extern char *cache_key(const char *ifile, const char *ppfile,
+                       char *options[], const char *kind);
+extern bool cache_get(const char *key, const char *ofile);
+extern void cache_put(const char *key, const char *ofile);
+extern void cache_report(bool verbose);
+
+#endif /* CACHE_H */
@@ -1,11 +1,22 @@
+#include "compat.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/socket.h>
 #include "cc.h"
 
 struct options opts;
 
+extern char **environ;
+
+static jmp_buf *unit_env;       // set while a batch unit is compiled
+
 static void parse_opts(int argc, char *argv[])
 {
+    const char *ofile = NULL;
+
     for (int i = 1; i < argc; i++) {
         const char *arg = argv[i];
         if (!strcmp(arg, "-o")) {
@@ -24,47 +35,414 @@ static void parse_opts(int argc, char *argv[])
             opts.fleading_underscore = true;
         } else if (!strcmp(arg, "-ansi")) {
             opts.ansi = true;
+        } else if (!strncmp(arg, "-batch=", 7)) {
+            opts.batch = arg + 7;
+        } else if (!strcmp(arg, "-funity")) {
+            opts.unity = true;
+        } else if (!strcmp(arg, "-M") || !strcmp(arg, "-MM")) {
+            opts.deps_only = true;
+        } else if (!strcmp(arg, "-MF") || !strcmp(arg, "-MT") ||
+                   !strcmp(arg, "-include-pch")) {
+            // the value is for libcpp
+            i++;
+        } else if (!strcmp(arg, "-emit-pch")) {
+            opts.emit_pch = true;
         } else if (arg[0] != '-' || !strcmp(arg, "-")) {
             if (opts.ifile == NULL)
                 opts.ifile = arg;
-            else if (opts.ofile == NULL)
-                opts.ofile = arg;
+            else if (ofile == NULL)
+                ofile = arg;
         }
     }
+    // with -funity every file argument is an input
+    if (opts.ofile == NULL && !opts.unity)
+        opts.ofile = ofile;
+    if (opts.ofile == NULL && opts.emit_pch && opts.ifile &&
+        strcmp(opts.ifile, "-"))
+        opts.ofile = format("%s.pch", opts.ifile);
+}
 
-    // reopen stdout
-    if (opts.ofile && strcmp(opts.ofile, "-")) {
-        if (freopen(opts.ofile, "w", stdout) == NULL)
-            die("can't write file: %s", opts.ofile);
-    }
+// a real file, not stdin/stdout
+static bool is_file(const char *path)
+{
+    return path && strcmp(path, "-");
 }
 
 static void preprocess(void)
 {
     struct token *t = get_pptok(cpp_file);
-    for (; t->id != EOI; t = get_pptok(cpp_file))
+    for (; t->id != EOI; t = get_pptok(cpp_file)) {
         print("%t", t);
+        if (t->id == '\n')
+            cpp_release_tokens();
+    }
 }
 
-static void doexit(void)
+/**
+ * Fatal errors end the process, or only the current
+ * unit in batch mode.
+ */
+void cc_exit(void)
 {
-    debug_exit();
+    if (unit_env)
+        longjmp(*unit_env, 1);
+    exit(EXIT_FAILURE);
 }
 
-int main(int argc, char *argv[])
+/**
+ * Called when the next input of a unity build starts.
+ * Macros and include guards carry over, but the statics,
+ * typedefs and tags of the finished file go out of scope.
+ */
+static void next_unit(const char *prev)
+{
+    hide_file_scope(prev);
+}
+
+static int compile(int argc, char *argv[])
 {
-    atexit(doexit);
-    parse_opts(argc, argv);
-    debug_init(argc, argv);
     actions.init(argc, argv);
     symbol_init();
     type_init();
     cpp_init(argc, argv);
+    cpp_unit_handler = next_unit;
 
-    if (opts.preprocess_only)
+    if (opts.emit_pch)
+        cpp_emit_pch(cpp_file, stdout);
+    else if (opts.deps_only)
+        cpp_scan(cpp_file);
+    else if (opts.preprocess_only)
         preprocess();
     else
         translation_unit();
+    if (errors() == 0)
+        cpp_write_deps();
+    cpp_write_report();
 
     return errors() > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
+
+/**
+ * Tables of the previous unit are kept until the next
+ * one starts, so that -debugS can still dump the last.
+ *
+ * PERM is freed here, so whatever outlives a unit (the
+ * interned strings and hidesets, the caches of the
+ * server) must not be allocated in it, and the statics
+ * pointing into it are reset by the X_begin() of their
+ * module.
+ */
+static void reset_unit(void)
+{
+    if (cpp_file)
+        cpp_finish();
+    deallocate(FUNC);
+    deallocate(PERM);
+    reset_errors();
+    cscope = GLOBAL;
+}
+
+/**
+ * The output is written to 'ofile.tmp' and renamed into
+ * place only if the unit compiled, so a crash never leaves
+ * a truncated output that looks like a compiled one.
+ */
+static int compile_unit(int argc, char *argv[])
+{
+    jmp_buf env;
+    int ret = EXIT_FAILURE;
+    char *tmp = NULL;
+
+    reset_unit();
+    if (is_file(opts.ifile) && access(opts.ifile, R_OK) != 0) {
+        fprint(stderr, "can't read file: %s\n", opts.ifile);
+        return EXIT_FAILURE;
+    }
+    if (is_file(opts.ofile)) {
+        tmp = format("%s.tmp", opts.ofile);
+        if (freopen(tmp, "w", stdout) == NULL) {
+            fprint(stderr, "can't write file: %s\n", tmp);
+            free(tmp);
+            return EXIT_FAILURE;
+        }
+    }
+    if (setjmp(env) == 0) {
+        unit_env = &env;
+        ret = compile(argc, argv);
+    }
+    unit_env = NULL;
+    if (fflush(stdout) != 0 && ret == EXIT_SUCCESS) {
+        fprint(stderr, "can't write file: %s\n", tmp ? tmp : "<stdout>");
+        ret = EXIT_FAILURE;
+    }
+    if (tmp) {
+        if (ret == EXIT_SUCCESS && rename(tmp, opts.ofile) != 0) {
+            fprint(stderr, "can't write file: %s\n", opts.ofile);
+            ret = EXIT_FAILURE;
+        }
+        if (ret != EXIT_SUCCESS)
+            remove(tmp);
+        free(tmp);
+    }
+    return ret;
+}
+
+/**
+ * Compile every unit listed in the manifest in one
+ * process. Each line is 'input<TAB>output', the other
+ * command line options apply to all of them.
+ * The output of a failed unit is removed.
+ */
+static int batch(int argc, char *argv[])
+{
+    FILE *fp = fopen(opts.batch, "r");
+    char **av = xmalloc((argc + 2) * sizeof(char *));
+    int ac = 1;
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    int ret = EXIT_SUCCESS;
+
+    if (fp == NULL)
+        die("can't read file: %s", opts.batch);
+
+    // argv[1] is the input of the current unit
+    av[0] = argv[0];
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (!strcmp(arg, "-o"))
+            i++;
+        else if (arg[0] == '-' && strcmp(arg, "-") &&
+                 strncmp(arg, "-batch=", 7))
+            av[++ac] = argv[i];
+    }
+    av[++ac] = NULL;
+
+    cpp_fatal_handler = cc_exit;
+    while ((len = getline(&line, &size, fp)) != -1) {
+        if (len > 0 && line[len - 1] == '\n')
+            line[--len] = 0;
+        if (len == 0)
+            continue;
+        char *tab = strchr(line, '\t');
+        if (tab == NULL) {
+            fprint(stderr, "%s: missing output file: %s\n",
+                   opts.batch, line);
+            ret = EXIT_FAILURE;
+            continue;
+        }
+        *tab = 0;
+        opts.ifile = av[1] = strdup(line);
+        opts.ofile = strdup(tab + 1);
+        if (compile_unit(ac, av) != EXIT_SUCCESS)
+            ret = EXIT_FAILURE;
+    }
+
+    free(line);
+    fclose(fp);
+    return ret;
+}
+
+/**
+ * Compile server.
+ *
+ * A request carries the cwd, argv and environment of a
+ * cc1 invocation as NUL terminated strings:
+ *
+ *   cwd argc argv[0] ... argv[argc-1] envc env[0] ...
+ *
+ * along with the client's stdin, stdout and stderr, so
+ * the diagnostics go straight to the client. The reply
+ * is the exit status and the output file.
+ *
+ * The workers are forked once the socket is bound and
+ * take turns to accept. Each keeps the file contents
+ * and header lookups of libcpp warm across requests.
+ */
+static volatile sig_atomic_t server_quit;
+
+static void server_signal(int sig)
+{
+    server_quit = 1;
+}
+
+static char **unpack(char **pp, char *end, int *count)
+{
+    char *p = *pp;
+    char **v;
+    int n;
+
+    if (p >= end)
+        return NULL;
+    n = atoi(p);
+    p += strlen(p) + 1;
+    v = xmalloc((n + 1) * sizeof(char *));
+    for (int i = 0; i < n; i++) {
+        if (p >= end) {
+            free(v);
+            return NULL;
+        }
+        v[i] = p;
+        p += strlen(p) + 1;
+    }
+    v[n] = NULL;
+    *pp = p;
+    if (count)
+        *count = n;
+    return v;
+}
+
+static void serve_request(int conn, const int saved[3])
+{
+    size_t len;
+    int fds[3];
+    char *req = sock_recv(conn, &len, fds, 3);
+    char *p, *end, *cwd;
+    char **argv, **envp, **env = environ;
+    int argc;
+    int ret = EXIT_FAILURE;
+
+    if (req == NULL)
+        return;
+    p = req;
+    end = req + len;
+    cwd = p;
+    p += strlen(p) + 1;
+    argv = unpack(&p, end, &argc);
+    envp = argv ? unpack(&p, end, NULL) : NULL;
+
+    for (int i = 0; i < 3; i++) {
+        if (fds[i] >= 0) {
+            dup2(fds[i], i);
+            close(fds[i]);
+        }
+    }
+
+    if (argv && envp && chdir(cwd) == 0) {
+        environ = envp;
+        memset(&opts, 0, sizeof(opts));
+        memset(debug, 0, sizeof(debug));
+        parse_opts(argc, argv);
+        debug_init(argc, argv);
+        if (opts.batch)
+            ret = batch(argc, argv);
+        else
+            ret = compile_unit(argc, argv);
+        environ = env;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = 0; i < 3; i++)
+        dup2(saved[i], i);
+
+    const char *status = format("%d", ret);
+    const char *ofile = is_file(opts.ofile) ? opts.ofile : "";
+    struct strbuf *reply = strbuf_new();
+    strbuf_catn(reply, status, strlen(status) + 1);
+    strbuf_catn(reply, ofile, strlen(ofile) + 1);
+    sock_send(conn, reply->str, reply->len, NULL, 0);
+    strbuf_free(reply);
+    free(argv);
+    free(envp);
+    free(req);
+}
+
+static void worker(int lfd)
+{
+    int saved[3];
+
+    for (int i = 0; i < 3; i++)
+        saved[i] = dup(i);
+    cpp_cache_init();
+    cpp_fatal_handler = cc_exit;
+    for (;;) {
+        int conn = accept(lfd, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            die("accept: %s", strerror(errno));
+        }
+        // another user's request would run as this one
+        if (sock_peer_ok(conn))
+            serve_request(conn, saved);
+        close(conn);
+    }
+}
+
+static pid_t start_worker(int lfd)
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        worker(lfd);
+        _exit(EXIT_SUCCESS);
+    }
+    return pid;
+}
+
+static int serve(const char *path)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    int lfd;
+    struct sigaction sa;
+    pid_t *pids;
+
+    if (path == NULL)
+        die("no private directory for the server socket");
+    if ((lfd = sock_listen(path)) < 0)
+        die("can't listen on %s: %s", path, strerror(errno));
+    if (n <= 0)
+        n = 1;
+
+    // no SA_RESTART, wait() returns on a signal
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = server_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    pids = xmalloc(n * sizeof(pid_t));
+    for (long i = 0; i < n; i++)
+        pids[i] = start_worker(lfd);
+
+    while (!server_quit) {
+        pid_t pid = wait(NULL);
+        if (pid < 0)
+            continue;
+        // a worker died (e.g. die()), replace it
+        for (long i = 0; i < n; i++)
+            if (pids[i] == pid && !server_quit)
+                pids[i] = start_worker(lfd);
+    }
+
+    for (long i = 0; i < n; i++)
+        if (pids[i] > 0)
+            kill(pids[i], SIGTERM);
+    while (wait(NULL) > 0)
+        ;
+    unlink(path);
+    return EXIT_SUCCESS;
+}
+
+static void doexit(void)
+{
+    debug_exit();
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && !strcmp(argv[1], "--server"))
+        return serve(argc > 2 ? argv[2] : sock_default_path());
+
+    atexit(doexit);
+    parse_opts(argc, argv);
+    debug_init(argc, argv);
+
+    if (opts.batch)
+        return batch(argc, argv);
+    if (is_file(opts.ofile) && freopen(opts.ofile, "w", stdout) == NULL)
+        die("can't write file: %s", opts.ofile);
+    return compile(argc, argv);
+}
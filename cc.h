@@ -28,8 +28,12 @@ struct options {
     int Wall:1;
     int Werror:1;
     int ansi:1;
+    int unity:1;                // the inputs make up one unit
+    int deps_only:1;            // -M, -MM
+    int emit_pch:1;             // write a precompiled header
     const char *ifile;
     const char *ofile;
+    const char *batch;          // manifest of translation units
 };
 
 /*
@@ -486,6 +490,8 @@ extern struct symbol *temporary(int, int);
 extern struct symbol *lookup(const char *, struct table *);
 // install a symbol with specified scope
 extern struct symbol *install(const char *, struct table **, int, int);
+// hide the file-scope names of a finished unity input
+extern void hide_file_scope(const char *);
 
 /// ast.c
 extern struct field *alloc_field(void);
@@ -613,9 +619,13 @@ extern short ty2op(struct type *);
 // alias
 #define rtype(ty)  TYPE_TYPE(ty)
 
+// cc.c
+extern void cc_exit(void);
+
 // error.c
 extern unsigned int errors(void);
 extern unsigned int warnings(void);
+extern void reset_errors(void);
 extern void warning_at(struct source, const char *, ...);
 extern void error_at(struct source, const char *, ...);
 extern void fatal_at(struct source, const char *, ...);
@@ -0,0 +1,8 @@
+/* Auto-generated by makefile. */
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#define VERSION "0.4.0-dev"
+#define _9CC_LIB_DIR "/root/repo"
+
+#endif
@@ -19,11 +19,16 @@ unsigned int warnings(void)
     return cc_warnings + cpp_file->warnings;
 }
 
+void reset_errors(void)
+{
+    cc_errors = cc_warnings = 0;
+}
+
 static void exit_if_too_many_errors(void)
 {
     if (errors() >= MAX_ERRORS) {
         fprint(stderr, "Too many errors.\n");
-        exit(EXIT_FAILURE);
+        cc_exit();
     }
 }
 
@@ -84,7 +89,7 @@ void fatal_at(struct source src, const char *fmt, ...)
     va_start(ap, fmt);
     cc_print_lead(FTL, src, fmt, ap);
     va_end(ap);
-    exit(EXIT_FAILURE);
+    cc_exit();
 }
 
 void intal_at(struct source src, const char *fmt, ...)
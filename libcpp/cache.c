@@ -0,0 +1,134 @@
+#include "compat.h"
+#include <stdlib.h>
+#include <limits.h>
+#include "internal.h"
+#include "libutils.h"
+
+/**
+ * Header lookups kept across the translation units of
+ * a long running cc1 (--server). The file contents are
+ * kept by with_file().
+ *
+ * A lookup is used as long as the mtime of its directory
+ * is unchanged, since creating or removing a file touches
+ * the directory. Directories are checked at most once
+ * per unit.
+ */
+
+#define NBUCKETS  1024
+
+struct cdir {
+    const char *path;
+    struct timespec mtime;      // zero if missing
+    unsigned int gen;           // unit it was last checked in
+    struct cdir *link;
+};
+
+struct centry {
+    const char *path;
+    struct cdir *dir;
+    struct timespec dir_mtime;
+    bool exists;
+    bool looked_up;
+    struct centry *link;
+};
+
+static bool enabled;
+static unsigned int gen;
+static const char *cwd;
+static struct centry *entries[NBUCKETS];
+static struct cdir *dirs[NBUCKETS];
+
+void cpp_cache_init(void)
+{
+    enabled = true;
+}
+
+// called when a unit starts
+void cache_begin(void)
+{
+    char buf[PATH_MAX];
+
+    if (!enabled)
+        return;
+    gen++;
+    free((void *)cwd);
+    cwd = strdup(getcwd(buf, sizeof(buf)) ? buf : "");
+}
+
+// paths relative to the cwd of the request
+static const char *cache_key(const char *path)
+{
+    if (path[0] == '/')
+        return path;
+    return join(cwd, path);
+}
+
+static bool same_time(struct timespec a, struct timespec b)
+{
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+static struct centry *lookup_entry(const char *key)
+{
+    unsigned int h = strhash(key) & (NBUCKETS - 1);
+    struct centry *p;
+
+    for (p = entries[h]; p; p = p->link)
+        if (!strcmp(p->path, key))
+            return p;
+
+    p = zmalloc(sizeof(struct centry));
+    p->path = strdup(key);
+    p->link = entries[h];
+    entries[h] = p;
+    return p;
+}
+
+static struct cdir *lookup_dir(const char *path)
+{
+    unsigned int h = strhash(path) & (NBUCKETS - 1);
+    struct cdir *p;
+    struct stat st;
+
+    for (p = dirs[h]; p; p = p->link)
+        if (!strcmp(p->path, path))
+            break;
+
+    if (p == NULL) {
+        p = zmalloc(sizeof(struct cdir));
+        p->path = strdup(path);
+        p->link = dirs[h];
+        dirs[h] = p;
+    } else if (p->gen == gen) {
+        return p;
+    }
+
+    if (stat(path, &st) == 0)
+        p->mtime = ST_MTIM(&st);
+    else
+        p->mtime = (struct timespec){ 0, 0 };
+    p->gen = gen;
+    return p;
+}
+
+int cache_fexists(const char *path)
+{
+    if (!enabled)
+        return fexists(path);
+
+    const char *key = cache_key(path);
+    struct centry *p = lookup_entry(key);
+    char *tmp = strdup(key);
+    struct cdir *dir = lookup_dir(dirname(tmp));
+
+    free(tmp);
+
+    if (!p->looked_up || p->dir != dir || !same_time(p->dir_mtime, dir->mtime)) {
+        p->exists = fexists(key);
+        p->dir = dir;
+        p->dir_mtime = dir->mtime;
+        p->looked_up = true;
+    }
+    return p->exists;
+}
@@ -1,4 +1,6 @@
 #include "compat.h"
+#include <stdlib.h>
+#include <ctype.h>
 #include <locale.h>
 #include <time.h>
 #include <assert.h>
@@ -10,15 +12,42 @@ static struct vector *expandv(struct file *pfile, struct vector *v);
 static void include_file(struct file *pfile, const char *name, bool std);
 static struct token *token_zero = &(struct token){
     .id = ICONSTANT,
-    .u.lit.str = "0",
-    .u.lit.v.i = 0
+    .u.lit = &(struct literal){ .str = "0", .v.i = 0 }
 };
 static struct token *token_one = &(struct token){
     .id = ICONSTANT,
-    .u.lit.str = "1",
-    .u.lit.v.i = 1
+    .u.lit = &(struct literal){ .str = "1", .v.i = 1 }
 };
 
+/**
+ * Scratch of macro expansion.
+ *
+ * The arguments of an invocation and their expansions are
+ * ranges of 'scratch', and the replacement is built on
+ * 'output'. Both are stacks: an invocation pops what it
+ * pushed once the result is back in the input, so nested
+ * invocations reuse the same memory.
+ */
+struct arg {
+    size_t begin, end;          // in scratch
+    size_t xbegin, xend;        // the expansion, if 'expanded'
+    bool expanded;
+};
+
+static struct vector *scratch;
+static struct vector *output;
+static struct arg *args;
+static size_t nargs, alloc_args;
+
+static void add_arg(size_t begin, size_t end)
+{
+    if (nargs == alloc_args) {
+        alloc_args = alloc_args * 2 + 16;
+        args = xrealloc(args, alloc_args * sizeof(struct arg));
+    }
+    args[nargs++] = (struct arg){ .begin = begin, .end = end };
+}
+
 static void do_if(struct file *);
 static void do_ifdef(struct file *);
 static void do_ifndef(struct file *);
@@ -91,12 +120,6 @@ void unget(struct file *pfile, struct token *t)
     vec_push(pfile->buffer->ungets, t);
 }
 
-static void ungetv(struct file *pfile, struct vector *v)
-{
-    for (int i = vec_len(v) - 1; i >= 0; i--)
-        unget(pfile, vec_at(v, i));
-}
-
 static struct token *defined_op(struct file *pfile, struct token *t)
 {
     /* 'defined' operator:
@@ -113,14 +136,14 @@ static struct token *defined_op(struct file *pfile, struct token *t)
         if (t2->id == ID && t3->id == ')') {
             return mdefined(t2->u.ident) ? token_one : token_zero;
         } else {
-            cpp_error_at(t->src,
+            cpp_error_at(TOK_SRC(t),
                          "expect 'identifier )' after 'defined ('");
             unget(pfile, t3);
             unget(pfile, t2);
             return t;
         }
     } else {
-        cpp_error_at(t->src,
+        cpp_error_at(TOK_SRC(t),
                      "expect identifier or ( after defined operator");
         return t;
     }
@@ -165,7 +188,8 @@ static bool eval_constexpr(struct file *pfile)
     // so that get_pptok will not
     // generate 'unterminated conditional directive'
     buffer_sentinel(pfile,
-                    with_tokens(vec_reverse(tokens), pfile->buffer),
+                    with_tokens((struct token **)tokens->mem,
+                                vec_len(tokens), pfile->buffer),
                     BS_RETURN_EOI);
     bool ret = eval_cpp_const_expr();
     buffer_unsentinel(pfile);
@@ -192,6 +216,8 @@ static void do_elif(struct file *pfile)
     if (stack == NULL)
         cpp_error("#elif without #if");
     bool b = eval_constexpr(pfile);
+    if (stack && stack->prev == NULL && pfile->buffer->mi_state == MI_INSIDE)
+        pfile->buffer->mi_state = MI_INVALID;
     if (stack) {
         if (stack->b || !b)
             skip_ifstack(pfile);
@@ -212,6 +238,8 @@ static void do_else(struct file *pfile)
         cpp_error("extra tokens in #else directive");
         skipline(pfile);
     }
+    if (stack && stack->prev == NULL && pfile->buffer->mi_state == MI_INSIDE)
+        pfile->buffer->mi_state = MI_INVALID;
     if (stack) {
         if (stack->b)
             skip_ifstack(pfile);
@@ -222,10 +250,14 @@ static void do_else(struct file *pfile)
 
 static void do_endif(struct file *pfile)
 {
-    if (pfile->buffer->ifstack)
+    struct buffer *pb = pfile->buffer;
+    if (pb->ifstack)
         if_unsentinel(pfile);
     else
         cpp_error("#endif without #if");
+    // the end of the guard
+    if (pb->ifstack == NULL && pb->mi_state == MI_INSIDE)
+        pb->mi_state = MI_AFTER;
     struct token *t = skip_spaces(pfile);
     if (!IS_NEWLINE(t) && t->id != EOI) {
         cpp_error("extra tokens in #endif");
@@ -243,6 +275,12 @@ static void do_ifdef_section(struct file *pfile, int id)
     bool b = mdefined(t->u.ident);
     bool skip = id == IFDEF ? !b : b;
 
+    // directive() lets only the first #ifndef through
+    if (pfile->buffer->mi_state == MI_START) {
+        pfile->buffer->mi_state = MI_INSIDE;
+        pfile->buffer->mi_guard = t->u.ident;
+    }
+
     if_sentinel(pfile, &(struct ifstack){.id = id,.src = src,.b = !skip});
 
     t = skip_spaces(pfile);
@@ -292,7 +330,7 @@ static void do_include(struct file *pfile)
             for (int i = 1; i < vec_len(r); i++) {
                 struct token *t = vec_at(r, i);
                 if (!IS_SPACE(t)) {
-                    cpp_error_at(t->src, "extra tokens at "
+                    cpp_error_at(TOK_SRC(t), "extra tokens at "
                                  "end of #include directive '%s'",
                                  tok2s(t));
                     break;
@@ -319,51 +357,44 @@ static void do_include(struct file *pfile)
     }
 }
 
-static struct vector *arg(struct file *pfile)
+/**
+ * Read the arguments of an invocation of 'm' to the
+ * scratch, returns the first in 'args'. Spaces are merged
+ * to one, and newlines are spaces here. The commas stay
+ * between the arguments for the variable ones.
+ */
+static size_t arguments(struct file *pfile, struct macro *m, size_t *count)
 {
-    struct vector *v = vec_new();
+    size_t first = nargs;
+    size_t begin = vec_len(scratch);
     int parens = 0;
-    struct token *t;
     bool space = false;
+    struct token *t;
+    size_t n;
+
     for (;;) {
-        /**
-         * Merge multiple spaces to one,
-         * treat newline as space here.
-         */
         t = lex(pfile);
         if (IS_SPACE(t) || IS_NEWLINE(t)) {
             space = true;
             continue;
         }
         if (space)
-            vec_push(v, space_token);
+            vec_push(scratch, space_token);
+        space = false;
         if (((t->id == ',' || t->id == ')') && parens == 0) ||
-            t->id == EOI)
-            break;
+            t->id == EOI) {
+            add_arg(begin, vec_len(scratch));
+            if (t->id != ',')
+                break;
+            vec_push(scratch, t);
+            begin = vec_len(scratch);
+            continue;
+        }
         if (t->id == '(')
             parens++;
         else if (t->id == ')')
             parens--;
-        vec_push(v, t);
-        space = false;
-    }
-    unget(pfile, t);
-    return v;
-}
-
-static struct vector *arguments(struct file *pfile, struct macro *m)
-{
-    struct vector *v = vec_new();
-    struct vector *commas = vec_new();
-    struct token *t;
-    for (;;) {
-        struct vector *r = arg(pfile);
-        vec_push(v, r);
-        t = lex(pfile);
-        if (t->id == ')' || t->id == EOI)
-            break;
-        assert(t->id == ',');
-        vec_push(commas, t);
+        vec_push(scratch, t);
     }
     if (t->id != ')')
         cpp_error("unterminated function-like macro invocation");
@@ -371,44 +402,35 @@ static struct vector *arguments(struct file *pfile, struct macro *m)
         unget(pfile, t);
 
     // remove leading and trailing space
-    if (vec_len(v)) {
-        struct vector *v1 = vec_head(v);
-        struct vector *v2 = vec_tail(v);
-        while (vec_len(v1) && IS_SPACE(vec_head(v1)))
-            vec_pop_front(v1);
-        while (vec_len(v2) && IS_SPACE(vec_tail(v2)))
-            vec_pop(v2);
-        // if the only arg is empty, then remove it
-        if (vec_len(v) == 1 && vec_empty(vec_head(v)))
-            vec_pop(v);
-    }
+    n = nargs - first;
+    while (args[first].begin < args[first].end &&
+           IS_SPACE(scratch->mem[args[first].begin]))
+        args[first].begin++;
+    while (args[nargs - 1].end > args[nargs - 1].begin &&
+           IS_SPACE(scratch->mem[args[nargs - 1].end - 1]))
+        args[nargs - 1].end--;
+    // if the only arg is empty, then remove it
+    if (n == 1 && args[first].begin == args[first].end)
+        n = 0;
 
-    size_t lenv = vec_len(v);
-    size_t lenp = m->nparams;
     // check args and params
-    if (lenv < lenp) {
+    if (n < m->nparams) {
         cpp_error("too few arguments "
                   "provided to function-like macro invocation");
-    } else if (lenv > lenp) {
+    } else if (n > m->nparams) {
         if (m->varg) {
             // merge 'variable arguments'
-            struct vector *v2 = vec_new();
-            for (int i = lenp; i < lenv; i++) {
-                vec_add(v2, vec_at(v, i));
-                if (i != lenv - 1)
-                    vec_push(v2, vec_at(commas, i));
-            }
-            int i = lenv - lenp;
-            while (i--)
-                vec_pop(v);
-            vec_push(v, v2);
+            args[first + m->nparams].end = args[nargs - 1].end;
+            n = m->nparams + 1;
         } else {
             cpp_error("too many arguments "
                       "provided to function-like macro invocation");
         }
     }
 
-    return v;
+    nargs = first + n;
+    *count = n;
+    return first;
 }
 
 static void parameters(struct file *pfile, struct macro *m)
@@ -447,6 +469,7 @@ static void parameters(struct file *pfile, struct macro *m)
                     n = n * 2 + 16;
                     v = xrealloc(v, n * sizeof(struct token *));
                 }
+                t = perm_token(t);
                 t->param = true;
                 t->pos = i;
                 v[i++] = t;
@@ -463,7 +486,7 @@ static void parameters(struct file *pfile, struct macro *m)
             t = skip_spaces(pfile);
         }
         if (t->id != ')') {
-            cpp_error_at(t->src, "unterminated macro parameter list");
+            cpp_error_at(TOK_SRC(t), "unterminated macro parameter list");
             unget(pfile, t);
         }
         break;
@@ -524,7 +547,7 @@ static void ensure_macro_def(struct token *t, struct macro *m)
 
     if (m1) {
         if (m1->builtin) {
-            cpp_error_at(t->src, "Can't redefine predefined macro '%s'",
+            cpp_error_at(TOK_SRC(t), "Can't redefine predefined macro '%s'",
                          name);
         } else {
             size_t len2p = m1->nparams;
@@ -555,7 +578,7 @@ static void ensure_macro_def(struct token *t, struct macro *m)
             return;
 
         redef:
-            cpp_error_at(t->src, "'%s' macro redefinition, "
+            cpp_error_at(TOK_SRC(t), "'%s' macro redefinition, "
                          "previous definition at %s:%u:%u",
                          name, m1->src.file, m1->src.line,
                          m1->src.column);
@@ -564,23 +587,23 @@ static void ensure_macro_def(struct token *t, struct macro *m)
     }
 
     if (!strcmp(name, "defined"))
-        cpp_error_at(t->src, "'defined' cannot be used as a macro name");
+        cpp_error_at(TOK_SRC(t), "'defined' cannot be used as a macro name");
 
     for (size_t i = 0; i < len1b; i++) {
         struct token *t = m->body[i];
         if (t->id == SHARPSHARP) {
             if (i == 0)
-                cpp_error_at(t->src, "'##' cannot appear at "
+                cpp_error_at(TOK_SRC(t), "'##' cannot appear at "
                              "the beginning of a replacement list");
             else if (i == len1b - 1)
-                cpp_error_at(t->src, "'##' cannot appear at "
+                cpp_error_at(TOK_SRC(t), "'##' cannot appear at "
                              "the end of a replacement list");
         } else if (t->id == '#') {
             struct token *t1 = i + 1 < len1b ? m->body[i+1] : NULL;
             if (m->kind != MACRO_FUNC ||
                 t1 == NULL ||
                 !t1->param)
-                cpp_error_at(t->src,
+                cpp_error_at(TOK_SRC(t),
                              "'#' is not followed by a macro parameter");
         }
     }
@@ -596,6 +619,7 @@ static void replacement_list(struct file *pfile, struct macro *m)
     for (;;) {
         if (IS_NEWLINE(t) || t->id == EOI)
             break;
+        t = perm_token(t);
         t->space = space;
         if (i >= n) {
             n = n * 2 + 64;
@@ -635,7 +659,7 @@ static void define_objlike_macro(struct file *pfile, struct token *t)
     struct macro *m = NEWS0(struct macro, PERM);
     SAVE_ERRORS;
     m->kind = MACRO_OBJ;
-    m->src = t->src;
+    m->src = TOK_SRC(t);
     replacement_list(pfile, m);
     ensure_macro_def(t, m);
     if (NO_ERROR)
@@ -647,7 +671,7 @@ static void define_funclike_macro(struct file *pfile, struct token *t)
     struct macro *m = NEWS0(struct macro, PERM);
     SAVE_ERRORS;
     m->kind = MACRO_FUNC;
-    m->src = t->src;
+    m->src = TOK_SRC(t);
     parameters(pfile, m);
     replacement_list(pfile, m);
     ensure_macro_def(t, m);
@@ -732,7 +756,7 @@ static void do_line(struct file *pfile)
 
     t = alloc_token();
     t->id = LINENO;
-    t->u.lit.str = name;
+    alloc_literal(t)->str = name;
     unget(pfile, t);
 }
 
@@ -779,20 +803,33 @@ static inline void do_warning(struct file *pfile)
 static void do_pragma(struct file *pfile)
 {
     struct source src = source;
-    struct token *t;
-    for (;;) {
+    struct token *t = skip_spaces(pfile);
+
+    if (t->id == ID && !strcmp(TOK_ID_STR(t), "once")) {
         t = skip_spaces(pfile);
-        if (IS_NEWLINE(t) || t->id == EOI)
-            break;
+        if (IS_NEWLINE(t) || t->id == EOI) {
+            lookup_header(pfile, pfile->buffer->name)->once = true;
+            return;
+        }
+        cpp_warning_at(src, "extra tokens at end of #pragma once");
+        skipline(pfile);
+        return;
     }
+    while (!IS_NEWLINE(t) && t->id != EOI)
+        t = skip_spaces(pfile);
     cpp_warning_at(src, "pragma directive not supported yet");
 }
 
 static void directive(struct file *pfile)
 {
+    struct buffer *pb = pfile->buffer;
     struct token *t = skip_spaces(pfile);
     if (IS_NEWLINE(t) || t->id == EOI)
         return;
+    cpp_counts.directives++;
+    if (pb->mi_state != MI_INSIDE)
+        pb->mi_state = pb->mi_state == MI_START && t->id == ID &&
+            !strcmp(TOK_ID_STR(t), "ifndef") ? MI_START : MI_INVALID;
     if (t->id == ICONSTANT) {
         unget(pfile, t);
         do_line(pfile);
@@ -813,24 +850,43 @@ static void directive(struct file *pfile)
     skipline(pfile);
 }
 
-static struct vector *expandv(struct file *pfile, struct vector *v)
+// push the expansion of scratch[begin, end), returns where it starts
+static size_t expand_range(struct file *pfile, size_t begin, size_t end)
 {
-    struct vector *r = vec_new();
+    size_t out = vec_len(scratch);
 
+    if (begin == end)
+        return out;
     // create a temp file
     // so that get_pptok will not
     // generate 'unterminated conditional directive'
     buffer_sentinel(pfile,
-                    with_tokens(vec_reverse(v), pfile->buffer),
+                    with_tokens((struct token **)scratch->mem + begin,
+                                end - begin, pfile->buffer),
                     BS_RETURN_EOI);
+    expand_depth++;
     for (;;) {
         struct token *t = expand(pfile);
         if (t->id == EOI)
             break;
-        vec_push(r, t);
+        vec_push(scratch, t);
     }
+    expand_depth--;
     buffer_unsentinel(pfile);
 
+    return out;
+}
+
+static struct vector *expandv(struct file *pfile, struct vector *v)
+{
+    struct vector *r = vec_new();
+    size_t mark = vec_len(scratch);
+
+    vec_add(scratch, v);
+    for (size_t i = expand_range(pfile, mark, vec_len(scratch));
+         i < vec_len(scratch); i++)
+        vec_push(r, scratch->mem[i]);
+    scratch->len = mark;
     return r;
 }
 
@@ -859,46 +915,67 @@ static struct token *with_tmp_lex(struct file *pfile, const char *input)
     return t;
 }
 
-static struct vector *hsadd(struct vector *r, struct hideset *hideset)
+static bool is_ident_text(const char *s)
 {
-    size_t len = vec_len(r);
-    for (size_t i = 0; i < len; i++) {
-        struct token *t = vec_at(r, i);
-        t->hideset = hideset_union(t->hideset, hideset);
-    }
-    return r;
+    for (; *s; s++)
+        if (!isalnum((unsigned char)*s) && *s != '_')
+            return false;
+    return true;
 }
 
 /**
- * Paste last of left side with first of right side.
- * The 'rs' is selected with no leading spaces and trailing spaces.
+ * Paste 'l' and 'r'. An identifier followed by identifier
+ * characters is an identifier, which is made directly;
+ * anything else is lexed again.
  */
-static struct vector *glue(struct file *pfile,
-                           struct vector *ls, struct vector *rs)
+static struct token *paste(struct file *pfile, struct token *l, struct token *r)
 {
-    struct vector *r = vec_new();
+    const char *ls = tok2s(l);
+    const char *rs = tok2s(r);
+    size_t llen = strlen(ls);
+    size_t rlen = strlen(rs);
+    char buf[128];
+    struct token *t;
+
+    if (l->id != ID || llen + rlen >= sizeof(buf) || !is_ident_text(rs))
+        return with_tmp_lex(pfile, format("%s%s", ls, rs));
 
-    while (vec_len(ls) && IS_SPACE(vec_tail(ls)))
-        vec_pop(ls);
+    memcpy(buf, ls, llen);
+    memcpy(buf + llen, rs, rlen);
+    t = alloc_token();
+    t->id = ID;
+    t->bol = true;
+    t->loc = l->loc;
+    t->u.ident = idtab_lookup(pfile->idtab, buf, llen + rlen, ID_CREATE);
+    return t;
+}
 
-    if (vec_empty(ls)) {
-        vec_add(r, rs);
-        return r;
-    } else if (vec_empty(rs)) {
-        vec_add(r, ls);
-        return r;
+/**
+ * Paste the last of the output with the first of 'rs', and
+ * add the rest. The 'rs' is selected with no leading spaces
+ * and trailing spaces.
+ */
+static void glue(struct file *pfile, size_t out, struct token **rs, size_t n)
+{
+    while (vec_len(output) > out && IS_SPACE(vec_tail(output)))
+        vec_pop(output);
+
+    if (vec_len(output) == out) {
+        for (size_t i = 0; i < n; i++)
+            vec_push(output, rs[i]);
+        return;
+    } else if (n == 0) {
+        return;
     }
 
-    struct token *ltok = vec_pop(ls);
-    struct token *rtok = vec_pop_front(rs);
-    const char *str = format("%s%s", tok2s(ltok), tok2s(rtok));
-    struct token *t = with_tmp_lex(pfile, str);
+    struct token *ltok = vec_pop(output);
+    struct token *rtok = rs[0];
+    struct token *t = paste(pfile, ltok, rtok);
     t->hideset = hideset_intersection(ltok->hideset, rtok->hideset);
 
-    vec_add(r, ls);
-    vec_push(r, t);
-    vec_add(r, rs);
-    return r;
+    vec_push(output, t);
+    for (size_t i = 1; i < n; i++)
+        vec_push(output, rs[i]);
 }
 
 static const char *backslash(const char *name)
@@ -917,11 +994,11 @@ static const char *backslash(const char *name)
  * Stringify tokens.
  * The 'v' is selected with no leading and trailing spaces.
  */
-static struct token *stringize(struct vector *v)
+static struct token *stringize(struct token **v, size_t n)
 {
     struct strbuf *s = strbuf_new();
-    for (int i = 0; i < vec_len(v); i++) {
-        struct token *t = vec_at(v, i);
+    for (size_t i = 0; i < n; i++) {
+        struct token *t = v[i];
         const char *name = tok2s(t);
         /*
           Any embedded quotation or backslash characters
@@ -941,7 +1018,7 @@ static struct token *stringize(struct vector *v)
 
     struct token *t = alloc_token();
     t->id = SCONSTANT;
-    t->u.lit.str = strbuf_str(s);
+    alloc_literal(t)->str = strs(strbuf_str(s));
     return t;
 }
 
@@ -949,27 +1026,72 @@ static struct token *stringize(struct vector *v)
  * Select an argument for expansion.
  * Remove the leading and trailing spaces.
  */
-static struct vector *selct(struct vector *args, int index)
+static struct token **selct(size_t first, size_t count, unsigned int index,
+                            size_t *n)
 {
-    struct vector *v = vec_new();
-    vec_add(v, vec_at_safe(args, index));
-    while (vec_len(v) && IS_SPACE(vec_head(v)))
-        vec_pop_front(v);
-    while (vec_len(v) && IS_SPACE(vec_tail(v)))
-        vec_pop(v);
-    return v;
+    size_t begin, end;
+
+    if (index >= count) {
+        *n = 0;
+        return NULL;
+    }
+    begin = args[first + index].begin;
+    end = args[first + index].end;
+    while (begin < end && IS_SPACE(scratch->mem[begin]))
+        begin++;
+    while (end > begin && IS_SPACE(scratch->mem[end - 1]))
+        end--;
+    *n = end - begin;
+    return (struct token **)scratch->mem + begin;
 }
 
-static struct vector *subst(struct file *pfile,
-                            struct macro *m,
-                            struct vector *args,
-                            struct hideset *hideset)
+/**
+ * The expansion of an argument, which is done once per
+ * invocation however many times the body uses it.
+ */
+static void expanded(struct file *pfile, size_t first, size_t count,
+                     unsigned int index, size_t *begin, size_t *end)
 {
-    struct vector *r = vec_new();
+    struct arg *a;
+
+    if (index >= count) {
+        *begin = *end = 0;
+        return;
+    }
+    a = &args[first + index];
+    if (!a->expanded) {
+        size_t n, x;
+        struct token **v = selct(first, count, index, &n);
+        size_t b = v ? v - (struct token **)scratch->mem : 0;
+        x = expand_range(pfile, b, b + n);
+        // the table may have moved
+        a = &args[first + index];
+        a->xbegin = x;
+        a->xend = vec_len(scratch);
+        a->expanded = true;
+    }
+    *begin = a->xbegin;
+    *end = a->xend;
+}
+
+/**
+ * Push the replacement of 'm' back to the input. The
+ * arguments are 'count' entries of 'args' from 'first'.
+ * 'c' is the profile of the expansion, if any.
+ */
+static void subst(struct file *pfile,
+                  struct macro *m,
+                  size_t first, size_t count,
+                  struct hideset *hideset,
+                  struct mcall *c)
+{
+    size_t out = vec_len(output);
     struct token **body = m->body;
     size_t len = m->nbody;
+    struct token **iv;
+    size_t n;
 
-#define PUSH_SPACE(r, t)    if (t->space) vec_push(r, space_token)
+#define PUSH_SPACE(t)    if (t->space) vec_push(output, space_token)
 
     for (size_t i = 0; i < len; i++) {
         struct token *t0 = body[i];
@@ -978,41 +1100,43 @@ static struct vector *subst(struct file *pfile,
         bool t1_inparams = t1 && t1->param;
 
         if (t0->id == '#' && t1_inparams) {
-            struct vector *iv = selct(args, t1->pos);
-            struct token *ot = stringize(iv);
-            PUSH_SPACE(r, t0);
-            vec_push(r, ot);
+            iv = selct(first, count, t1->pos, &n);
+            struct token *ot = stringize(iv, n);
+            PUSH_SPACE(t0);
+            vec_push(output, ot);
             i++;
 
         } else if (t0->id == SHARPSHARP && t1_inparams) {
 
-            struct vector *iv = selct(args, t1->pos);
-            if (vec_len(iv))
-                r = glue(pfile, r, iv);
+            iv = selct(first, count, t1->pos, &n);
+            if (n)
+                glue(pfile, out, iv, n);
             i++;
 
         } else if (t0->id == SHARPSHARP && t1) {
 
             hideset = t1->hideset;
-            r = glue(pfile, r, vec_new1(t1));
+            glue(pfile, out, &t1, 1);
             i++;
 
         } else if (t0_inparams && (t1 && t1->id == SHARPSHARP)) {
 
             hideset = t1->hideset;
-            struct vector *iv = selct(args, t0->pos);
-            if (vec_len(iv)) {
-                PUSH_SPACE(r, t0);
-                vec_add(r, iv);
+            iv = selct(first, count, t0->pos, &n);
+            if (n) {
+                PUSH_SPACE(t0);
+                for (size_t j = 0; j < n; j++)
+                    vec_push(output, iv[j]);
             } else {
                 // add a space
-                vec_push(r, space_token);
+                vec_push(output, space_token);
 
                 struct token *t2 = i + 2 < len ? body[i+2] : NULL;
                 bool t2_inparams = t2 && t2->param;
                 if (t2_inparams) {
-                    struct vector *iv2 = selct(args, t2->pos);
-                    vec_add(r, iv2);
+                    iv = selct(first, count, t2->pos, &n);
+                    for (size_t j = 0; j < n; j++)
+                        vec_push(output, iv[j]);
                     i++;
                 }
                 i++;
@@ -1020,17 +1144,35 @@ static struct vector *subst(struct file *pfile,
 
         } else if (t0_inparams) {
 
-            struct vector *iv = selct(args, t0->pos);
-            struct vector *ov = expandv(pfile, iv);
-            PUSH_SPACE(r, t0);
-            vec_add(r, ov);
+            size_t begin, end;
+            if (c) {
+                double start = report_clock();
+                expanded(pfile, first, count, t0->pos, &begin, &end);
+                c->pre += report_clock() - start;
+            } else {
+                expanded(pfile, first, count, t0->pos, &begin, &end);
+            }
+            PUSH_SPACE(t0);
+            for (size_t j = begin; j < end; j++)
+                vec_push(output, scratch->mem[j]);
 
         } else {
-            PUSH_SPACE(r, t0);
-            vec_push(r, t0);
+            PUSH_SPACE(t0);
+            vec_push(output, t0);
         }
     }
-    return hsadd(r, hideset);
+
+#undef PUSH_SPACE
+
+    if (c)
+        c->stat->tokens += vec_len(output) - out;
+    // add the hideset, and push back in order
+    for (size_t i = vec_len(output); i > out; i--) {
+        struct token *t = output->mem[i - 1];
+        t->hideset = hideset_union(t->hideset, hideset);
+        unget(pfile, t);
+    }
+    output->len = out;
 }
 
 static struct token *expand(struct file *pfile)
@@ -1050,12 +1192,22 @@ static struct token *expand(struct file *pfile)
 
     struct macro *m = ident->u.macro;
 
+    // the name counts outside the guard even if it expands to
+    // nothing, next_pptok() only sees what comes out
+    if (pfile->buffer->mi_state != MI_INSIDE)
+        pfile->buffer->mi_state = MI_INVALID;
+
     switch (m->kind) {
     case MACRO_OBJ:
         {
+            struct mcall call, *c = NULL;
+            if (macro_report)
+                macro_enter(c = &call, name, m, t->hideset);
             struct hideset *hdset = hideset_add(t->hideset, name);
-            struct vector *v = subst(pfile, m, NULL, hdset);
-            ungetv(pfile, v);
+            cpp_counts.expansions++;
+            subst(pfile, m, 0, 0, hdset, c);
+            if (c)
+                macro_leave(c);
             goto start;
         }
     case MACRO_FUNC:
@@ -1064,23 +1216,36 @@ static struct token *expand(struct file *pfile)
                 return t;
             SAVE_ERRORS;
             skip_spaces(pfile);
-            struct vector *args = arguments(pfile, m);
-            if (NO_ERROR) {
+            struct mcall call, *c = NULL;
+            if (macro_report)
+                macro_enter(c = &call, name, m, t->hideset);
+            size_t mark = vec_len(scratch);
+            size_t count;
+            size_t first = arguments(pfile, m, &count);
+            if (c)
+                c->args = report_clock() - c->start;
+            bool ok = NO_ERROR;
+            if (ok) {
                 struct token *rparen = skip_spaces(pfile);
                 assert(rparen->id == ')');
                 struct hideset *hdset =
                     hideset_add(hideset_intersection
                                 (t->hideset, rparen->hideset),
                                 name);
-                struct vector *v = subst(pfile, m, args, hdset);
-                ungetv(pfile, v);
-                goto start;
-            } else {
-                return t;
+                cpp_counts.expansions++;
+                subst(pfile, m, first, count, hdset, c);
             }
+            if (c)
+                macro_leave(c);
+            scratch->len = mark;
+            nargs = first;
+            if (!ok)
+                return t;
+            goto start;
         }
         break;
     case MACRO_SPECIAL:
+        cpp_counts.expansions++;
         m->handler(pfile, t);
         goto start;
     default:
@@ -1093,8 +1258,8 @@ static void file_handler(struct file *pfile, struct token *t)
     const char *file = pfile->buffer->name;
     struct token *tok = alloc_token();
     tok->id = SCONSTANT;
-    tok->u.lit.str = file;
-    tok->src = t->src;
+    alloc_literal(tok)->str = strs(file);
+    tok->loc = t->loc;
     unget(pfile, tok);
 }
 
@@ -1104,9 +1269,9 @@ static void line_handler(struct file *pfile, struct token *t)
     const char *name = strd(line);
     struct token *tok = alloc_token();
     tok->id = ICONSTANT;
-    tok->u.lit.str = name;
-    tok->u.lit.v.i = line;
-    tok->src = t->src;
+    alloc_literal(tok)->str = name;
+    tok->u.lit->v.i = line;
+    tok->loc = t->loc;
     unget(pfile, tok);
 }
 
@@ -1114,8 +1279,8 @@ static void date_handler(struct file *pfile, struct token *t)
 {
     struct token *tok = alloc_token();
     tok->id = SCONSTANT;
-    tok->u.lit.str = pfile->date;
-    tok->src = t->src;
+    alloc_literal(tok)->str = strs(pfile->date);
+    tok->loc = t->loc;
     unget(pfile, tok);
 }
 
@@ -1123,8 +1288,8 @@ static void time_handler(struct file *pfile, struct token *t)
 {
     struct token *tok = alloc_token();
     tok->id = SCONSTANT;
-    tok->u.lit.str = pfile->time;
-    tok->src = t->src;
+    alloc_literal(tok)->str = strs(pfile->time);
+    tok->loc = t->loc;
     unget(pfile, tok);
 }
 
@@ -1148,36 +1313,31 @@ static struct token *lineno(unsigned int line, const char *file)
     const char *name = format("# %u \"%s\"\n", line, file);
     struct token *t = alloc_token();
     t->id = LINENO;
-    t->u.lit.str = name;
-    t->src.file = "<built-in>";
+    alloc_literal(t)->str = name;
+    t->loc = make_loc("<built-in>", 0, 0);
     return t;
 }
 
-static const char *find_header(struct file *pfile,
-                               const char *name, bool isstd)
+struct header *lookup_header(struct file *pfile, const char *path)
 {
-    struct vector *paths;
-    if (isstd)
-        paths = pfile->std_include_paths;
-    else
-        paths = pfile->usr_include_paths;
-
-    size_t len = vec_len(paths);
-    for (size_t i = 0; i < len; i++) {
-        const char *dir = vec_at(paths, i);
-        const char *file = join(dir, name);
-        if (fexists(file))
-            return file;
-    }
-
-    if (!isstd) {
-        // try current path
-        const char *curdir = dirname(strdup(pfile->buffer->name));
-        const char *file = join(curdir, name);
-        if (fexists(file))
-            return file;
-    }
-    return NULL;
+    unsigned int h;
+    struct header *p;
+
+    // './h.h' and 'h.h' are the same header
+    while (path[0] == '.' && path[1] == '/')
+        path += 2;
+    h = strhash(path) & (NHEADERS - 1);
+
+    for (p = pfile->headers[h]; p; p = p->link)
+        if (!strcmp(p->path, path))
+            return p;
+
+    p = zmalloc(sizeof(struct header));
+    p->path = path;
+    p->seq = pfile->nheaders++;
+    p->link = pfile->headers[h];
+    pfile->headers[h] = p;
+    return p;
 }
 
 static void include_file(struct file *pfile, const char *name, bool std)
@@ -1189,10 +1349,24 @@ static void include_file(struct file *pfile, const char *name, bool std)
         return;
     }
 
-    path = find_header(pfile, name, std);
+    path = search_header(pfile, name, std, pfile->buffer->name);
 
     if (path) {
+        // a quoted include of a system header is one too
+        bool sys = std || pfile->buffer->sys;
+        deps_add(path, sys);
+        // no need to open it again
+        struct header *h = lookup_header(pfile, path);
+        h->sys = sys;
+        if (h->once || (h->guard && mdefined(h->guard))) {
+            // as if the file had ended
+            report_skip(path);
+            pfile->buffer->bol = true;
+            unget(pfile, lineno(pfile->buffer->line, pfile->buffer->name));
+            return;
+        }
         buffer_sentinel(pfile, with_file(path, name), BS_CONTINUOUS);
+        pfile->buffer->sys = sys;
         unget(pfile, lineno(1, pfile->buffer->name));
     } else {
         cpp_fatal("'%s' file not found", name);
@@ -1213,7 +1387,34 @@ static void init_builtin_macros(struct file *pfile)
     define_special(pfile, "__LINE__", line_handler);
     define_special(pfile, "__DATE__", date_handler);
     define_special(pfile, "__TIME__", time_handler);
-    include_file(pfile, "9cc.h", true);
+}
+
+/**
+ * Load the precompiled header 'path', or read its header
+ * as a plain -include if the image can't be used.
+ * Returns true if it was loaded.
+ */
+static bool include_pch(struct file *pfile, const char *path)
+{
+    const char *header;
+
+    if (pch_load(pfile, path, &header)) {
+        unget(pfile, lineno(1, pfile->buffer->name));
+        return true;
+    }
+    // 'h.h.pch' is made from 'h.h'
+    if (header == NULL && strlen(path) > 4 &&
+        !strcmp(path + strlen(path) - 4, ".pch"))
+        header = strndup(path, strlen(path) - 4);
+    if (header == NULL || !fexists(header)) {
+        fprintf(stderr, "can't use precompiled header: %s\n", path);
+        pfile->errors++;
+        return false;
+    }
+    deps_add(header, false);
+    buffer_sentinel(pfile, with_file(header, header), BS_CONTINUOUS);
+    unget(pfile, lineno(1, pfile->buffer->name));
+    return false;
 }
 
 static void init_env(struct file *pfile)
@@ -1233,8 +1434,10 @@ static void init_env(struct file *pfile)
 
 static void init_include_path(struct file *pfile)
 {
-    // add system include paths
-    struct vector *sys_include_paths = sys_include_dirs();
+    // add system include paths, the same for every unit
+    static struct vector *sys_include_paths;
+    if (sys_include_paths == NULL)
+        sys_include_paths = sys_include_dirs();
     for (int i = 0; i < vec_len(sys_include_paths); i++) {
         const char *dir = vec_at(sys_include_paths, i);
         add_include(pfile->std_include_paths, dir);
@@ -1244,12 +1447,38 @@ static void init_include_path(struct file *pfile)
 void cpp_init(int argc, char *argv[])
 {
     const char *ifile = NULL;
+    const char *pch = NULL;
+    bool unity = false;
+    bool readahead = false;
     struct strbuf *s = strbuf_new();
+    // a precompiled header needs the same
+    struct strbuf *key = strbuf_new();
     struct vector *v = vec_new();
+    struct vector *units = vec_new();
+
+    deps_begin();
+    report_begin();
+    search_begin();
+    // a fatal error may have left an expansion behind
+    if (scratch == NULL) {
+        scratch = vec_new();
+        output = vec_new();
+    }
+    scratch->len = output->len = nargs = 0;
+    loc_begin();
+    hideset_begin();
+    lex_begin();
 
     for (int i = 1; i < argc; i++) {
         const char *arg = argv[i];
-        if (!strncmp(arg, "-I", 2)) {
+        if (!strncmp(arg, "-I", 2) || !strncmp(arg, "-D", 2) ||
+            !strncmp(arg, "-U", 2))
+            strbuf_cats(key, format("%s\n", arg));
+        if (deps_option(argc, argv, &i) || report_option(arg)) {
+            continue;
+        } else if (!strcmp(arg, "-include-pch") && i + 1 < argc) {
+            pch = argv[++i];
+        } else if (!strncmp(arg, "-I", 2)) {
             if (arg[2])
                 vec_push(v, (char *)arg + 2);
         } else if (!strncmp(arg, "-D", 2)) {
@@ -1271,16 +1500,29 @@ void cpp_init(int argc, char *argv[])
         } else if (!strncmp(arg, "-U", 2)) {
             if (arg[2])
                 strbuf_cats(s, format("#undef %s\n", arg + 2));
+        } else if (!strcmp(arg, "-funity")) {
+            unity = true;
+        } else if (!strcmp(arg, "-freadahead")) {
+            readahead = true;
+        } else if (!strcmp(arg, "-flexer=switch")) {
+            lex_switch = true;
         } else if (arg[0] != '-' || !strcmp(arg, "-")) {
             if (ifile == NULL)
                 ifile = arg;
+            else
+                vec_push(units, (char *)arg);
         }
     }
 
     if (ifile == NULL || !strcmp(ifile, "-"))
         ifile = "";
 
+    cache_begin();
+    pch_begin(strbuf_str(key));
+    deps_add(ifile, false);
     cpp_file = input_init(ifile);
+    if (unity)
+        cpp_file->units = units;
     init_env(cpp_file);
     init_include_path(cpp_file);
     init_builtin_macros(cpp_file);
@@ -1289,24 +1531,140 @@ void cpp_init(int argc, char *argv[])
         const char *dir = vec_at(v, i);
         add_include(cpp_file->usr_include_paths, dir);
     }
+    if (readahead)
+        readahead_begin(cpp_file, ifile);
 
+    // the image has 9cc.h and the command line macros
+    if (pch && include_pch(cpp_file, pch))
+        return;
+    include_file(cpp_file, "9cc.h", true);
     if (strbuf_len(s))
         include_cmdline(cpp_file, s->str);
 }
 
-/// get one expanded token.
-struct token *get_pptok(struct file *pfile)
+// the oldest run of 'p' or 'seq'
+static unsigned int run_of(unsigned int seq, const void *p)
+{
+    for (struct tokenrun *run = cpp_file->tokenrun; run; run = run->prev)
+        if ((const char *)p >= run->base && (const char *)p < run->limit)
+            return MIN(seq, run->seq);
+    return seq;
+}
+
+static unsigned int live_run(unsigned int seq, struct token *t)
+{
+    if (t == NULL)
+        return seq;
+    seq = run_of(seq, t);
+    if (t->id != ID && t->u.lit)
+        seq = run_of(seq, t->u.lit);
+    return seq;
+}
+
+/**
+ * Free the token runs older than any live token. The
+ * caller is done with the tokens it has read, so only
+ * the lookahead and the pushed back tokens are left.
+ */
+void cpp_release_tokens(void)
+{
+    struct tokenrun *run = cpp_file->tokenrun;
+    struct tokenrun *dead;
+    unsigned int seq = run->seq;
+
+    if (run->prev == NULL)
+        return;
+
+    seq = live_run(seq, token);
+    seq = live_run(seq, ahead_token);
+    for (size_t i = 0; i < vec_len(cpp_file->tokens); i++)
+        seq = live_run(seq, vec_at(cpp_file->tokens, i));
+    for (struct buffer *pb = cpp_file->buffer; pb; pb = pb->prev)
+        for (size_t i = 0; i < vec_len(pb->ungets); i++)
+            seq = live_run(seq, vec_at(pb->ungets, i));
+
+    while (run->prev && run->prev->seq >= seq)
+        run = run->prev;
+    dead = run->prev;
+    run->prev = NULL;
+    while (dead) {
+        struct tokenrun *prev = dead->prev;
+        free(dead->base);
+        free(dead);
+        dead = prev;
+    }
+}
+
+/// release the tables of the current translation unit.
+void cpp_finish(void)
+{
+    struct tokenrun *run = cpp_file->tokenrun;
+    while (run) {
+        struct tokenrun *prev = run->prev;
+        free(run->base);
+        free(run);
+        run = prev;
+    }
+    idtab_free(cpp_file->idtab);
+    for (int i = 0; i < NHEADERS; i++) {
+        struct header *p = cpp_file->headers[i];
+        while (p) {
+            struct header *link = p->link;
+            free(p);
+            p = link;
+        }
+    }
+    free(cpp_file->headers);
+    free(cpp_file);
+    pch_end();
+    cpp_file = NULL;
+    token = ahead_token = NULL;
+}
+
+void (*cpp_unit_handler)(const char *prev);
+
+/**
+ * The next input of a unity build replaces the finished
+ * one at the bottom of the buffer stack. Macros and the
+ * include guards stay defined.
+ */
+static void next_unit(struct file *pfile)
+{
+    const char *prev = pfile->file;
+    const char *file = vec_at(pfile->units, pfile->next_unit++);
+
+    buffer_unsentinel(pfile);
+    pfile->file = file;
+    deps_add(file, false);
+    buffer_sentinel(pfile, with_file(file, file), BS_CONTINUOUS);
+    if (cpp_unit_handler)
+        cpp_unit_handler(prev);
+}
+
+/**
+ * Returns the next token after the directives, macros
+ * are expanded if 'expansion' is true.
+ */
+static struct token *next_pptok(struct file *pfile, bool expansion)
 {
     struct token *t;
 
- expand:
-    t = expand(pfile);
+ again:
+    t = expansion ? expand(pfile) : lex(pfile);
     if (t->id == EOI) {
-        if (pfile->buffer->ifstack)
-            cpp_error_at(pfile->buffer->ifstack->src,
+        struct buffer *pb = pfile->buffer;
+        if (pb->ifstack)
+            cpp_error_at(pb->ifstack->src,
                          "unterminated conditional directive");
-        if (pfile->buffer->return_eoi)
+        if (pb->return_eoi)
             return t;
+        if (pb->kind == BK_REGULAR && pb->mi_state == MI_AFTER)
+            lookup_header(pfile, pb->name)->guard = pb->mi_guard;
+        if (pfile->buffer->prev == NULL &&
+            pfile->next_unit < vec_len(pfile->units)) {
+            next_unit(pfile);
+            return lineno(1, pfile->file);
+        }
 
         buffer_unsentinel(pfile);
         if (pfile->buffer)
@@ -1316,7 +1674,26 @@ struct token *get_pptok(struct file *pfile)
     }
     if (t->id == '#' && t->bol) {
         directive(pfile);
-        goto expand;
+        goto again;
     }
+    if (pfile->buffer->mi_state != MI_INSIDE &&
+        !IS_SPACE(t) && !IS_NEWLINE(t) && !IS_LINENO(t))
+        pfile->buffer->mi_state = MI_INVALID;
     return t;
 }
+
+/// get one expanded token.
+struct token *get_pptok(struct file *pfile)
+{
+    // the tokens of a precompiled header come first
+    if (pfile->pch_tokens < pfile->pch_end)
+        return pfile->pch_tokens++;
+    return next_pptok(pfile, true);
+}
+
+/// run only the directives, for -M and -MM.
+void cpp_scan(struct file *pfile)
+{
+    while (next_pptok(pfile, false)->id != EOI)
+        ;
+}
@@ -0,0 +1,213 @@
+#include "compat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "internal.h"
+#include "libutils.h"
+
+/**
+ * Make-style dependencies (-M, -MM, -MD, -MMD).
+ *
+ * The headers are recorded by include_file() while the
+ * unit is preprocessed as usual, so writing the rule
+ * needs no extra pass over the source.
+ */
+
+#define NBUCKETS  256
+#define MAX_COLS  76
+
+struct dep {
+    const char *path;
+    struct dep *link;
+};
+
+static struct deps {
+    bool enabled;
+    bool user_only;             // -MM, -MMD: no system headers
+    bool phony;                 // -MP
+    bool only;                  // -M, -MM: output is the rule
+    const char *file;           // -MF
+    const char *ofile;          // -o
+    const char *main;           // first input
+    struct vector *targets;     // -MT
+    struct vector *paths;       // in include order
+    struct dep *buckets[NBUCKETS];
+} deps;
+
+static void free_deps(void)
+{
+    for (int i = 0; i < NBUCKETS; i++) {
+        struct dep *p = deps.buckets[i];
+        while (p) {
+            struct dep *link = p->link;
+            free(p);
+            p = link;
+        }
+    }
+    if (deps.targets)
+        vec_free(deps.targets);
+    if (deps.paths)
+        vec_free(deps.paths);
+    memset(&deps, 0, sizeof(deps));
+}
+
+// called before the options of a unit are parsed
+void deps_begin(void)
+{
+    free_deps();
+    deps.targets = vec_new();
+    deps.paths = vec_new();
+}
+
+/**
+ * Returns true if argv[*i] is a dependency option, the
+ * value of -MF or -MT may be joined or the next argument.
+ */
+bool deps_option(int argc, char *argv[], int *i)
+{
+    const char *arg = argv[*i];
+
+    if (!strcmp(arg, "-M") || !strcmp(arg, "-MM")) {
+        deps.enabled = deps.only = true;
+        deps.user_only = arg[2] == 'M';
+    } else if (!strcmp(arg, "-MD") || !strcmp(arg, "-MMD")) {
+        deps.enabled = true;
+        deps.user_only = arg[2] == 'M';
+    } else if (!strcmp(arg, "-MP")) {
+        deps.phony = true;
+    } else if (!strncmp(arg, "-MF", 3) || !strncmp(arg, "-MT", 3)) {
+        const char *value = arg[3] ? arg + 3 : NULL;
+        if (value == NULL && *i + 1 < argc)
+            value = argv[++*i];
+        if (value == NULL)
+            die("missing file name after '%s'", arg);
+        else if (arg[2] == 'F')
+            deps.file = value;
+        else
+            vec_push(deps.targets, (char *)value);
+    } else if (!strcmp(arg, "-o") && *i + 1 < argc) {
+        deps.ofile = argv[++*i];
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static const char *clean_path(const char *path)
+{
+    while (path[0] == '.' && path[1] == '/')
+        path += 2;
+    return path;
+}
+
+void deps_add(const char *path, bool sys)
+{
+    unsigned int h;
+    struct dep *p;
+
+    if (!deps.enabled || (sys && deps.user_only) || path[0] == '\0')
+        return;
+
+    path = clean_path(path);
+    h = strhash(path) & (NBUCKETS - 1);
+    for (p = deps.buckets[h]; p; p = p->link)
+        if (!strcmp(p->path, path))
+            return;
+
+    if (deps.main == NULL)
+        deps.main = path;
+    p = zmalloc(sizeof(struct dep));
+    p->path = path;
+    p->link = deps.buckets[h];
+    deps.buckets[h] = p;
+    vec_push(deps.paths, (char *)path);
+}
+
+/**
+ * Names after the first get a leading space, and a line
+ * is continued once it gets too long. Spaces are escaped
+ * for make and '$' is doubled.
+ */
+static void write_name(FILE *fp, const char *name, int *col)
+{
+    if (*col > 0) {
+        if (*col + strlen(name) + 1 > MAX_COLS) {
+            fputs(" \\\n", fp);
+            *col = 0;
+        }
+        fputc(' ', fp);
+        (*col)++;
+    }
+    for (const char *s = name; *s; s++) {
+        if (*s == ' ' || *s == '\t' || *s == '#') {
+            fputc('\\', fp);
+            (*col)++;
+        } else if (*s == '$') {
+            fputc('$', fp);
+            (*col)++;
+        }
+        fputc(*s, fp);
+        (*col)++;
+    }
+}
+
+static void write_rule(FILE *fp)
+{
+    int col = 0;
+
+    if (vec_len(deps.targets) == 0) {
+        const char *base = basename(strdup(deps.main ? deps.main : "-"));
+        vec_push(deps.targets, (char *)resuffix(base, "o"));
+    }
+    for (size_t i = 0; i < vec_len(deps.targets); i++)
+        write_name(fp, vec_at(deps.targets, i), &col);
+    fputc(':', fp);
+    col++;
+    for (size_t i = 0; i < vec_len(deps.paths); i++)
+        write_name(fp, vec_at(deps.paths, i), &col);
+    fputc('\n', fp);
+
+    // -MP: a phony target for every header
+    if (deps.phony) {
+        for (size_t i = 0; i < vec_len(deps.paths); i++) {
+            const char *path = vec_at(deps.paths, i);
+            if (path == deps.main)
+                continue;
+            col = 0;
+            fputc('\n', fp);
+            write_name(fp, path, &col);
+            fputs(":\n", fp);
+        }
+    }
+}
+
+/**
+ * Write the rule of the current unit: to stdout for -M
+ * and -MM unless -MF is given, to -MF or the output (or
+ * the input) with a .d suffix for -MD and -MMD.
+ */
+void cpp_write_deps(void)
+{
+    const char *path = deps.file;
+    FILE *fp;
+
+    if (!deps.enabled)
+        return;
+
+    if (path == NULL && !deps.only) {
+        const char *base = deps.ofile && strcmp(deps.ofile, "-") ?
+            deps.ofile : basename(strdup(deps.main ? deps.main : "-"));
+        path = resuffix(base, "d");
+    }
+
+    if (path == NULL || !strcmp(path, "-")) {
+        write_rule(stdout);
+        return;
+    }
+    if ((fp = fopen(path, "w")) == NULL) {
+        fprintf(stderr, "can't write file: %s\n", path);
+        cpp_file->errors++;
+        return;
+    }
+    write_rule(fp);
+    fclose(fp);
+}
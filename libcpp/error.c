@@ -5,6 +5,8 @@
 #include "color.h"
 #include "internal.h"
 
+void (*cpp_fatal_handler)(void);
+
 static void
 cc_print_lead(int tag, struct source src, const char *fmt, va_list ap)
 {
@@ -55,5 +57,7 @@ void cpp_fatal_at(struct source src, const char *fmt, ...)
     va_start(ap, fmt);
     cc_print_lead(FTL, src, fmt, ap);
     va_end(ap);
+    if (cpp_fatal_handler)
+        cpp_fatal_handler();
     exit(EXIT_FAILURE);
 }
@@ -52,7 +52,7 @@ static cpp_num primary(void)
     
     switch (t) {
     case ICONSTANT:
-        num = token->u.lit.v.i;
+        num = token->u.lit->v.i;
         expect(t);
         break;
 
@@ -1,39 +1,241 @@
+#include <stdlib.h>
+#include <stdint.h>
 #include "internal.h"
 #include "libutils.h"
 
+/**
+ * Hidesets of macro expansion.
+ *
+ * A hideset is a sorted array of macro names. The names
+ * are interned, so they are ordered and compared by
+ * address. The sets are interned too: equal sets are one
+ * object, and NULL is the empty set.
+ *
+ * hsadd() takes the same union for every token of an
+ * expansion, so the results of add, union and
+ * intersection are cached by their operands.
+ *
+ * Like the names, the sets are xmalloc'd and live as long
+ * as the process, not in PERM: the static tokens, the
+ * table and the cache keep them from one unit of a batch
+ * or of the server to the next.
+ */
+
+#define NMEMO  4096
+
+enum { HS_ADD, HS_UNION, HS_INTERSECTION };
+
+struct memo {
+    int op;
+    const void *a, *b;
+    struct hideset *r;
+};
+
+static struct hideset **sets;
+static unsigned int nsets, nbuckets;
+static struct memo memo[NMEMO];
+static const char **buf;        // the set being built
+static unsigned int buflen;
+static struct {
+    unsigned int ops;
+    unsigned int hits;
+} stats;
+
+// called when a unit starts
+void hideset_begin(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+static unsigned int hash_names(const char **names, unsigned int len)
+{
+    unsigned int h = 2166136261u;
+    for (unsigned int i = 0; i < len; i++)
+        h = (h ^ (unsigned int)((uintptr_t)names[i] >> 3)) * 16777619u;
+    return h;
+}
+
+static void rehash(void)
+{
+    unsigned int n = nbuckets ? nbuckets * 2 : 256;
+    struct hideset **table = xcalloc(n, sizeof(struct hideset *));
+
+    for (unsigned int i = 0; i < nbuckets; i++) {
+        struct hideset *s = sets[i];
+        while (s) {
+            struct hideset *link = s->link;
+            s->link = table[s->hash & (n - 1)];
+            table[s->hash & (n - 1)] = s;
+            s = link;
+        }
+    }
+    free(sets);
+    sets = table;
+    nbuckets = n;
+}
+
+// the set of the first 'len' names of 'buf'
+static struct hideset *intern(unsigned int len)
+{
+    unsigned int h;
+    struct hideset *s;
+
+    if (len == 0)
+        return NULL;
+    h = hash_names(buf, len);
+    if (nbuckets)
+        for (s = sets[h & (nbuckets - 1)]; s; s = s->link)
+            if (s->hash == h && s->len == len &&
+                !memcmp(s->names, buf, len * sizeof(const char *)))
+                return s;
+
+    if (nsets >= nbuckets)
+        rehash();
+    s = xmalloc(sizeof(struct hideset) + len * sizeof(const char *));
+    s->hash = h;
+    s->len = len;
+    memcpy(s->names, buf, len * sizeof(const char *));
+    s->link = sets[h & (nbuckets - 1)];
+    sets[h & (nbuckets - 1)] = s;
+    nsets++;
+    return s;
+}
+
+static void reserve(unsigned int len)
+{
+    if (len > buflen) {
+        buflen = len * 2;
+        buf = xrealloc(buf, buflen * sizeof(const char *));
+    }
+}
+
+static struct memo *lookup(int op, const void *a, const void *b)
+{
+    uintptr_t h = ((uintptr_t)a >> 4) * 31 + ((uintptr_t)b >> 4) + op;
+    struct memo *m = &memo[(h ^ (h >> 12)) & (NMEMO - 1)];
+
+    stats.ops++;
+    if (m->op == op && m->a == a && m->b == b) {
+        stats.hits++;
+        return m;
+    }
+    m->op = op;
+    m->a = a;
+    m->b = b;
+    m->r = NULL;
+    return m;
+}
+
+static inline bool before(const char *a, const char *b)
+{
+    return (uintptr_t)a < (uintptr_t)b;
+}
+
 struct hideset *hideset_add(struct hideset *s, const char *name)
 {
-    struct hideset *r = NEWS0(struct hideset, PERM);
-    r->name = name;
-    r->next = s;
-    return r;
+    struct memo *m;
+    unsigned int i, j = 0;
+
+    if (hideset_has(s, name))
+        return s;
+    m = lookup(HS_ADD, s, name);
+    if (m->r)
+        return m->r;
+
+    reserve((s ? s->len : 0) + 1);
+    for (i = 0; s && i < s->len && before(s->names[i], name); i++)
+        buf[j++] = s->names[i];
+    buf[j++] = name;
+    for (; s && i < s->len; i++)
+        buf[j++] = s->names[i];
+    return m->r = intern(j);
 }
 
-bool hideset_has(struct hideset * s, const char *name)
+bool hideset_has(struct hideset *s, const char *name)
 {
-    for (; s; s = s->next) {
-        if (s->name == name)
+    unsigned int lo = 0, hi;
+
+    if (s == NULL)
+        return false;
+    hi = s->len;
+    while (lo < hi) {
+        unsigned int mid = (lo + hi) / 2;
+        if (s->names[mid] == name)
             return true;
+        if (before(s->names[mid], name))
+            lo = mid + 1;
+        else
+            hi = mid;
     }
     return false;
 }
 
 struct hideset *hideset_union(struct hideset *a, struct hideset *b)
 {
-    struct hideset *r = a;
-    for (; b; b = b->next) {
-        if (!hideset_has(a, b->name))
-            r = hideset_add(r, b->name);
+    struct memo *m;
+    unsigned int i = 0, j = 0, k = 0;
+
+    if (b == NULL || a == b)
+        return a;
+    if (a == NULL)
+        return b;
+    m = lookup(HS_UNION, a, b);
+    if (m->r)
+        return m->r;
+
+    reserve(a->len + b->len);
+    while (i < a->len && j < b->len) {
+        if (a->names[i] == b->names[j]) {
+            buf[k++] = a->names[i++];
+            j++;
+        } else if (before(a->names[i], b->names[j])) {
+            buf[k++] = a->names[i++];
+        } else {
+            buf[k++] = b->names[j++];
+        }
     }
-    return r;
+    while (i < a->len)
+        buf[k++] = a->names[i++];
+    while (j < b->len)
+        buf[k++] = b->names[j++];
+    return m->r = intern(k);
 }
 
 struct hideset *hideset_intersection(struct hideset *a, struct hideset *b)
 {
-    struct hideset *r = NULL;
-    for (; a; a = a->next) {
-        if (hideset_has(b, a->name))
-            r = hideset_add(r, a->name);
+    struct memo *m;
+    unsigned int i = 0, j = 0, k = 0;
+
+    if (a == NULL || b == NULL)
+        return NULL;
+    if (a == b)
+        return a;
+    m = lookup(HS_INTERSECTION, a, b);
+    if (m->r)
+        return m->r;
+
+    reserve(MIN(a->len, b->len));
+    while (i < a->len && j < b->len) {
+        if (a->names[i] == b->names[j]) {
+            buf[k++] = a->names[i++];
+            j++;
+        } else if (before(a->names[i], b->names[j])) {
+            i++;
+        } else {
+            j++;
+        }
     }
-    return r;
+    return m->r = intern(k);
+}
+
+// for -fmacro-report
+unsigned long hideset_ops(void)
+{
+    return stats.ops;
+}
+
+void hideset_dump(void)
+{
+    dlog("hideset: %u sets, %u operations, %u cached.",
+         nsets, stats.ops, stats.hits);
 }
@@ -3,29 +3,66 @@
 #include "internal.h"
 #include "libutils.h"
 
-static void idtab_expand(struct idtab *);
+struct keyword {
+    const char *name;
+    unsigned int len;
+    int id;
+};
+
+// generated by tools/mkkw.c
+#include "kwtab.h"
+
+// the token id of a keyword, 0 otherwise
+static int keyword(const char *str, size_t len)
+{
+    const struct keyword *k;
+
+    if (len < KW_MINLEN || len > KW_MAXLEN)
+        return 0;
+    k = &kwtab[KW_HASH((const unsigned char *)str, len)];
+    if (k->len == len && !memcmp(k->name, str, len))
+        return k->id;
+    return 0;
+}
+
+/**
+ * The identifiers of a unit, keyed by their name interned
+ * by strtab.c: open addressing on the hash kept with the
+ * name, comparing the pointers.
+ */
 
 struct idtab *idtab_new(unsigned int cap)
 {
     struct idtab *t = zmalloc(sizeof(struct idtab));
     unsigned int nslots = 1 << cap;
     t->nslots = nslots;
-    t->table = xcalloc(nslots, sizeof(struct idtab_entry *));
+    t->table = xcalloc(nslots, sizeof(struct ident *));
     return t;
 }
 
 void idtab_free(struct idtab *t)
 {
+    free(t->table);
+    free(t);
+}
+
+static void idtab_expand(struct idtab *t)
+{
+    unsigned int n = t->nslots * 2;
+    struct ident **table = xcalloc(n, sizeof(struct ident *));
+
     for (unsigned int i = 0; i < t->nslots; i++) {
-        struct idtab_entry *entry = t->table[i];
-        while (entry) {
-            struct idtab_entry *next = entry->link;
-            free(entry);
-            entry = next;
+        struct ident *id = t->table[i];
+        if (id) {
+            unsigned int j = STR_HASH(id->str) & (n - 1);
+            while (table[j])
+                j = (j + 1) & (n - 1);
+            table[j] = id;
         }
     }
     free(t->table);
-    free(t);
+    t->table = table;
+    t->nslots = n;
 }
 
 struct ident *idtab_lookup(struct idtab *t,
@@ -40,74 +77,44 @@ struct ident *idtab_lookup_with_hash(struct idtab *t,
                                      unsigned int hash,
                                      enum idtab_lookup_option opt)
 {
-    unsigned int index;
-    struct idtab_entry *p;
-    struct ident *result;
+    const char *name;
+    struct ident *id;
+    unsigned int i, n = 1;
 
-    t->searches++;
-    index = hash & (t->nslots - 1);
-
-    for (p = t->table[index]; p; p = p->link)
-        if (p->ident->len == len && !strncmp(str, p->ident->str, len))
-            return p->ident;
-
-    if (t->table[index])
-        t->collisions++;
     if (opt == ID_SEARCH)
+        name = strfind(str, len, hash);
+    else
+        name = strnh(str, len, hash);
+    if (name == NULL)
         return NULL;
 
-    result = t->alloc_ident(t);
-    result->len = len;
-    result->hash = hash;
-    result->str = strndup(str, len);
-    
-    p = xmalloc(sizeof(struct idtab_entry));
-    p->ident = result;
-    p->link = t->table[index];
-    t->table[index] = p;
-
+    t->searches++;
+    for (i = hash & (t->nslots - 1); (id = t->table[i]); i = (i + 1) & (t->nslots - 1), n++)
+        if (id->str == name)
+            break;
+    probes_add(&t->probes, n);
+    if (id || opt == ID_SEARCH)
+        return id;
+
+    id = t->alloc_ident(t);
+    id->str = name;
+    id->keyword = keyword(str, len);
+    t->table[i] = id;
     if (++t->nelements * 4 >= t->nslots * 3)
         idtab_expand(t);
-
-    return result;
-}
-
-static void idtab_expand(struct idtab *t)
-{
-    unsigned int oldsize = t->nslots;
-    struct idtab_entry **oldtable = t->table;
-    unsigned int sizemask;
-
-    t->nslots = oldsize * 2;
-    t->table = xcalloc(t->nslots, sizeof(struct idtab_entry *));
-    sizemask = t->nslots - 1;
-
-    for (unsigned int i = 0; i < oldsize; i++) {
-        struct idtab_entry *entry = oldtable[i];
-        while (entry) {
-            struct idtab_entry *next = entry->link;
-            unsigned int index = entry->ident->hash & sizemask;
-            entry->link = t->table[index];
-            t->table[index] = entry;
-            entry = next;
-        }
-    }
-    free(oldtable);
+    return id;
 }
 
 void idtab_foreach(struct idtab *t, idtab_cb cb, const void *v)
 {
-    struct idtab_entry *p;
-
     for (unsigned int i = 0; i < t->nslots; i++)
-        for (p = t->table[i]; p; p = p->link)
-            if (cb(t, p->ident, v))
-                goto stop;
- stop:;
+        if (t->table[i] && cb(t, t->table[i], v))
+            break;
 }
 
 void idtab_dump(struct idtab *t)
 {
-    dlog("idtab: %u elements, %u slots, %u searches, %u collisions.",
-         t->nelements, t->nslots, t->searches, t->collisions);
+    dlog("idtab: %u elements, %u slots, %u searches.",
+         t->nelements, t->nslots, t->searches);
+    probes_dump("idtab", &t->probes);
 }
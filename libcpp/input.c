@@ -3,11 +3,16 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <limits.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include "internal.h"
 #include "libutils.h"
 
 struct file *cpp_file;
 
+// token buffers are reused, macro expansion makes many
+static struct buffer *token_buffers;
+
 static struct buffer *new_buffer(void)
 {
     struct buffer *pb = zmalloc(sizeof(struct buffer));
@@ -21,23 +26,187 @@ static struct buffer *new_buffer(void)
 
 static void free_buffer(struct buffer *pb)
 {
-    free((void *)pb->buf);
+    if (pb->kind == BK_TOKEN) {
+        pb->prev = token_buffers;
+        token_buffers = pb;
+        return;
+    }
+    if (pb->map_len)
+        munmap((void *)pb->buf, pb->map_len);
+    else
+        free((void *)pb->buf);
     free(pb);
 }
 
+static struct buffer *file_buffer(const char *file, char *buf, size_t total)
+{
+    struct buffer *pb = new_buffer();
+    pb->kind = BK_REGULAR;
+    pb->name = file;
+    
+    /**
+     * Add a newline character to the end if the
+     * file doesn't have one, thus the include
+     * directive would work well.
+     */
+    buf[total] = '\n';
+    
+    pb->buf = (const unsigned char *)buf;
+    pb->cur = pb->line_base = pb->next_line = pb->buf;
+    pb->limit = &pb->buf[total];
+    return pb;
+}
+
+/**
+ * Large regular files are mapped MAP_PRIVATE: the lexer
+ * cleans lines in place, and only the pages it writes to
+ * are copied. The descriptors are kept by (dev, inode,
+ * mtime, size), so a file included again, or compiled
+ * again in batch or server mode, is mapped or read
+ * without being opened.
+ */
+struct mfile {
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    off_t size;
+    int fd;
+    struct mfile *link;
+};
+
+#define NMFILES    256
+#define MAX_OPEN   512          // descriptors kept open
+#define MAP_MIN    (128 * 1024)  // smaller files are read
+
+static struct mfile *mfiles[NMFILES];
+static int nopen;
+
+static void close_mfiles(void)
+{
+    for (int i = 0; i < NMFILES; i++) {
+        struct mfile *p = mfiles[i];
+        while (p) {
+            struct mfile *link = p->link;
+            close(p->fd);
+            free(p);
+            p = link;
+        }
+        mfiles[i] = NULL;
+    }
+    nopen = 0;
+}
+
+// returns the descriptor of 'file' described by 'st', -1 on error
+static int open_mfile(const char *file, const struct stat *st)
+{
+    unsigned int h = (unsigned int)st->st_ino & (NMFILES - 1);
+    struct mfile *p;
+    int fd;
+
+    for (p = mfiles[h]; p; p = p->link) {
+        if (p->dev != st->st_dev || p->ino != st->st_ino)
+            continue;
+        if (p->size == st->st_size &&
+            p->mtime.tv_sec == ST_MTIM(st).tv_sec &&
+            p->mtime.tv_nsec == ST_MTIM(st).tv_nsec)
+            return p->fd;
+        break;
+    }
+
+    if ((fd = open(file, O_RDONLY | O_NOCTTY)) < 0)
+        return -1;
+    if (p) {
+        // modified since
+        close(p->fd);
+    } else {
+        if (nopen == MAX_OPEN)
+            close_mfiles();
+        p = zmalloc(sizeof(struct mfile));
+        p->dev = st->st_dev;
+        p->ino = st->st_ino;
+        p->link = mfiles[h];
+        mfiles[h] = p;
+        nopen++;
+    }
+    p->fd = fd;
+    p->size = st->st_size;
+    p->mtime = ST_MTIM(st);
+    return fd;
+}
+
+// reads a small file from the kept descriptor
+static struct buffer *read_mfile(const char *file, int fd, size_t size)
+{
+    char *buf = xmalloc(size + 1);
+    size_t total = 0;
+    ssize_t count;
+
+    while (total < size &&
+           (count = pread(fd, buf + total, size - total, total)) > 0)
+        total += count;
+    if (total < size) {
+        free(buf);
+        return NULL;
+    }
+    return file_buffer(file, buf, size);
+}
+
+/**
+ * The mapping is one byte longer than the file for the
+ * '\n' sentinel. The tail of the last page is zeroed and
+ * private, but a file of whole pages has no tail, so the
+ * file is mapped over an anonymous reservation.
+ *
+ * The two mmap()s and the munmap() cost more than copying
+ * a header of a few pages, which is read instead.
+ */
+static struct buffer *map_file(const char *file, const struct stat *st)
+{
+    static long pagesize;
+    size_t size = st->st_size;
+    size_t len;
+    char *base;
+    int fd;
+
+    if ((fd = open_mfile(file, st)) < 0)
+        return NULL;
+    if (size < MAP_MIN)
+        return read_mfile(file, fd, size);
+    if (pagesize == 0)
+        pagesize = sysconf(_SC_PAGESIZE);
+    len = (size + 1 + pagesize - 1) / pagesize * pagesize;
+    base = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return NULL;
+    if (mmap(base, size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, len);
+        return NULL;
+    }
+
+    struct buffer *pb = file_buffer(file, base, size);
+    pb->map_len = len;
+    return pb;
+}
+
 struct buffer *with_file(const char *file, const char *name)
 {
     int fd;
-    struct buffer *pb;
     struct stat st;
     bool regular;
     ssize_t size, total, count;
     char *buf;
+    struct buffer *pb;
 
-    if (file[0] == '\0')
+    if (file[0] == '\0') {
         fd = 0;
-    else
+    } else if (stat(file, &st) == 0 && S_ISREG(st.st_mode) &&
+               st.st_size > 0 && (pb = map_file(file, &st))) {
+        return pb;
+    } else {
         fd = open(file, O_RDONLY | O_NOCTTY, 0666);
+    }
 
     if (fd == -1)
         die("Can't open file: %s (%s)", file, strerror(errno));
@@ -75,21 +244,7 @@ struct buffer *with_file(const char *file, const char *name)
         die("Can't read file: %s (%s)", file, strerror(errno));
 
     close(fd);
-    pb = new_buffer();
-    pb->kind = BK_REGULAR;
-    pb->name = file;
-    
-    /**
-     * Add a newline character to the end if the
-     * file doesn't have one, thus the include
-     * directive would work well.
-     */
-    buf[total] = '\n';
-    
-    pb->buf = (const unsigned char *)buf;
-    pb->cur = pb->line_base = pb->next_line = pb->buf;
-    pb->limit = &pb->buf[total];
-    return pb;
+    return file_buffer(file, buf, total);
 }
 
 struct buffer *with_string(const char *input, const char *name)
@@ -114,15 +269,27 @@ struct buffer *with_string(const char *input, const char *name)
     return pb;
 }
 
-struct buffer *with_tokens(struct vector *v, struct buffer *cur)
+// a buffer of the 'n' tokens of 'v'
+struct buffer *with_tokens(struct token **v, size_t n, struct buffer *cur)
 {
-    struct buffer *pb = new_buffer();
+    struct buffer *pb = token_buffers;
+    if (pb) {
+        struct vector *ungets = pb->ungets;
+        token_buffers = pb->prev;
+        memset(pb, 0, sizeof(struct buffer));
+        pb->bol = true;
+        vec_clear(ungets);
+        pb->ungets = ungets;
+    } else {
+        pb = new_buffer();
+    }
     pb->kind = BK_TOKEN;
     pb->name = cur->name;
     pb->line = cur->line;
     pb->column = cur->column;
     pb->need_line = false;
-    vec_add(pb->ungets, v);
+    while (n--)
+        vec_push(pb->ungets, v[n]);
     return pb;
 }
 
@@ -133,11 +300,15 @@ void buffer_sentinel(struct file *pfile, struct buffer *pb,
         pb->return_eoi = true;
     pb->prev = pfile->buffer;
     pfile->buffer = pb;
+    if (pb->kind == BK_REGULAR)
+        report_enter(pb);
 }
 
 void buffer_unsentinel(struct file *pfile)
 {
     struct buffer *prev = pfile->buffer->prev;
+    if (pfile->buffer->kind == BK_REGULAR)
+        report_leave(pfile->buffer);
     free_buffer(pfile->buffer);
     pfile->buffer = prev;
     // reset current 'bol'
@@ -182,9 +353,9 @@ struct file *input_init(const char *file)
     // 2^13: 8k slots
     pfile->idtab = idtab_new(13);
     pfile->idtab->alloc_ident = alloc_cpp_ident;
+    pfile->headers = zmalloc(NHEADERS * sizeof(struct header *));
     // tokenrun
-    pfile->tokenrun = next_tokenrun(NULL, 1024);
-    pfile->cur_token = pfile->tokenrun->base;
+    pfile->tokenrun = next_tokenrun(NULL);
 
     buffer_sentinel(pfile, with_file(file, file), BS_CONTINUOUS);
     return pfile;
@@ -192,6 +363,19 @@ struct file *input_init(const char *file)
 
 void cpp_dump(struct file *pfile)
 {
+    unsigned int nruns = 0;
+
+    for (struct tokenrun *run = pfile->tokenrun; run; run = run->prev)
+        nruns++;
+    dlog("tokens: %u bytes, %u of %u runs live.",
+         (unsigned int)sizeof(struct token), nruns, pfile->tokenrun->seq + 1);
     idtab_dump(pfile->idtab);
     strtab_dump();
+    scan_dump();
+    lex_dump();
+    search_dump();
+    hideset_dump();
+    loc_dump();
+    pch_dump();
+    readahead_dump();
 }
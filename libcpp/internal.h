@@ -4,6 +4,7 @@
 // for bool/size_t
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include "libcpp.h"
 
 ///
@@ -15,13 +16,21 @@ enum {
     DIGIT = 010, HEX = 020, OTHER = 040,
 };
 
-// tokens
+// tokens and literals are bump allocated from runs
 struct tokenrun {
-    struct token *base;
-    struct token *limit;
+    char *base;
+    char *cur;
+    char *limit;
+    unsigned int seq;                    // runs are freed oldest first
     struct tokenrun *prev;
 };
 
+#define TOKENRUN_SIZE     (64 * 1024)
+
+// locations
+#define LOC_COLUMN_BITS   11
+#define LOC_MAX_COLUMN    ((1U << LOC_COLUMN_BITS) - 1)
+
 struct line_note {
     const unsigned char *pos;
     int type;
@@ -30,14 +39,37 @@ struct line_note {
 // buffer kind
 enum { BK_REGULAR = 1, BK_STRING, BK_TOKEN };
 
+/**
+ * Multiple-include guard detection, a file is guarded if
+ * it is '#ifndef X ... #endif' with only spaces, newlines
+ * and comments outside.
+ */
+enum { MI_START, MI_INSIDE, MI_AFTER, MI_INVALID };
+
+#define NHEADERS  256
+
+// A header seen in the unit
+struct header {
+    const char *path;
+    struct ident *guard;                 // controlling macro
+    bool once;                           // #pragma once
+    bool sys;                            // found as a system header
+    unsigned int seq;                    // in include order
+    struct header *link;
+};
+
 // A buffer represents a file's content.
 struct buffer {
     int kind:8;                          // kind (regular/string)
     bool bol;                            // beginning of line
     bool return_eoi;                     // return eoi when reach the end
     bool need_line;
+    bool sys;                            // found in a system directory
+    int mi_state:8;                      // multiple-include guard state
+    struct ident *mi_guard;              // controlling macro
     const char *name;                    // buffer name
     const unsigned char *buf;            // entire buffer
+    size_t map_len;                      // length of the mapping, 0 if read
     const unsigned char *cur;            // current position
     const unsigned char *limit;          // end position
     const unsigned char *line_base;      // start of current physical line
@@ -94,7 +126,8 @@ extern struct file *input_init(const char *file);
 
 extern struct buffer *with_string(const char *input, const char *name);
 extern struct buffer *with_file(const char *file, const char *name);
-extern struct buffer *with_tokens(struct vector *v, struct buffer *cur);
+extern struct buffer *with_tokens(struct token **v, size_t n,
+                                  struct buffer *cur);
 
 extern void buffer_sentinel(struct file *pfile, struct buffer *pb,
                           enum buffer_sentinel_option opt);
@@ -107,31 +140,81 @@ extern bool is_original_file(struct file *pfile, const char *file);
 
 // cpp.c
 extern void unget(struct file *pfile, struct token *t);
+extern struct header *lookup_header(struct file *pfile, const char *path);
 
 // lex.c
 #define IS_SPACE(t)    (((struct token *)(t))->id == ' ')
 #define IS_NEWLINE(t)  (((struct token *)(t))->id == '\n')
 #define IS_LINENO(t)   (((struct token *)(t))->id == LINENO)
 
-struct tokenrun *next_tokenrun(struct tokenrun *prev, unsigned int count);
+struct tokenrun *next_tokenrun(struct tokenrun *prev);
 
 extern struct token *lex(struct file *pfile);
 extern struct token *header_name(struct file *pfile);
 extern struct token *alloc_token(void);
+extern struct token *copy_token(struct token *tok);
+extern struct literal *alloc_literal(struct token *t);
+extern struct token *perm_token(struct token *t);
 extern void skip_ifstack(struct file *pfile);
+extern void lex_begin(void);
+extern void lex_dump(void);
+extern bool lex_switch;
+
+// readahead.c
+extern void readahead_begin(struct file *pfile, const char *file);
+extern void readahead_dump(void);
+
+// report.c
+struct cpp_counts {
+    unsigned long tokens;                // lexed
+    unsigned long directives;
+    unsigned long expansions;
+};
 
-// strtab.c
-extern char *strs(const char *);
-extern char *strn(const char *, size_t);
-extern char *strd(long);
-extern char *stru(unsigned long);
+// macro stats of -fmacro-report
+struct mstat {
+    const char *name;
+    struct source src;                   // of the definition
+    unsigned long calls;
+    unsigned long tokens;                // in the replacements
+    unsigned int depth;                  // deepest nesting
+    double args, pre, subst, rescan;     // seconds
+    unsigned long hidesets;              // operations
+    struct mstat *link;
+};
+
+// an expansion being profiled
+struct mcall {
+    struct mstat *stat;
+    struct hideset *hideset;             // of the name
+    double start, args, pre;
+    unsigned long ops;
+};
+
+extern struct cpp_counts cpp_counts;
+extern unsigned int macro_report;
+extern unsigned int expand_depth;
+extern void report_begin(void);
+extern bool report_option(const char *arg);
+extern void report_enter(struct buffer *pb);
+extern void report_leave(struct buffer *pb);
+extern void report_skip(const char *path);
+extern double report_clock(void);
+extern void macro_enter(struct mcall *c, const char *name,
+                        struct macro *m, struct hideset *hideset);
+extern void macro_leave(struct mcall *c);
 
 // hideset.c
 struct hideset {
-    const char *name;
-    struct hideset *next;
+    unsigned int hash;
+    unsigned int len;
+    struct hideset *link;
+    const char *names[];                 // sorted by address
 };
 
+extern void hideset_begin(void);
+extern void hideset_dump(void);
+extern unsigned long hideset_ops(void);
 extern struct hideset *hideset_add(struct hideset *, const char *);
 extern bool hideset_has(struct hideset *, const char *);
 extern struct hideset *hideset_union(struct hideset *,
@@ -142,17 +225,19 @@ extern struct hideset *hideset_intersection(struct hideset *,
 // idtab
 enum idtab_lookup_option { ID_SEARCH = 0, ID_CREATE };
 
-struct idtab_entry {
-    struct ident *ident;
-    struct idtab_entry *link;
+// probe lengths of 1, 2, 3-4, 5-8, 9-16 and more
+#define NPROBES  6
+
+struct probes {
+    unsigned int n[NPROBES];
 };
 
 struct idtab {
-    struct idtab_entry **table;
+    struct ident **table;
     unsigned int nslots;        // number of slots
     unsigned int nelements;     // number of elements
     unsigned int searches;
-    unsigned int collisions;
+    struct probes probes;
     struct ident * (*alloc_ident) (struct idtab *);
 };
 
@@ -192,8 +277,48 @@ extern bool eval_cpp_const_expr(void);
 // sys.c
 extern struct vector *sys_include_dirs(void);
 
+// cache.c
+extern void cache_begin(void);
+extern int cache_fexists(const char *path);
+// loc.c
+extern void loc_begin(void);
+extern unsigned long long loc_reserve(unsigned int n);
+extern void loc_set_line(unsigned long long loc, const char *file,
+                         unsigned int line);
+extern unsigned long long make_loc(const char *file, unsigned int line,
+                                   unsigned int column);
+extern unsigned int loc_lines(void);
+extern void loc_dump(void);
+
+// pch.c
+extern void pch_begin(const char *options);
+extern void pch_end(void);
+extern bool pch_load(struct file *pfile, const char *path, const char **source);
+extern void pch_dump(void);
+
+// search.c
+extern void search_begin(void);
+extern const char *search_header(struct file *pfile, const char *name,
+                                 bool std, const char *from);
+extern void search_dump(void);
+
+// scan.c
+extern const unsigned char *scan_line(const unsigned char *s);
+extern const unsigned char *scan_newline(const unsigned char *s);
+extern const unsigned char *scan_comment(const unsigned char *s);
+extern const unsigned char *scan_ident(const unsigned char *s);
+extern const unsigned char *scan_skip(const unsigned char *s);
+extern void scan_dump(void);
+
+// deps.c
+extern void deps_begin(void);
+extern bool deps_option(int argc, char *argv[], int *i);
+extern void deps_add(const char *path, bool sys);
+
 // dump
 extern void strtab_dump(void);
+extern void probes_add(struct probes *, unsigned int);
+extern void probes_dump(const char *, struct probes *);
 
 ///
 /// external variables
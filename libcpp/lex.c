@@ -8,6 +8,8 @@
 #include <wchar.h>
 #include "libutils.h"
 #include "internal.h"
+// generated by tools/mklex.c
+#include "lextab.h"
 
 static unsigned char map[256] = {
 #define _a(a, b, c, d)  c,
@@ -31,6 +33,12 @@ static struct token *newline_token = &(struct token){.id = '\n'};
 struct token *space_token = &(struct token){.id = ' '};
 
 struct source source;
+bool lex_switch;                // -flexer=switch
+
+static struct {
+    unsigned int fast;          // lines of skipped groups scanned
+    unsigned int lexed;         // lines lexed, the directives
+} skip_stats;
 
 #define ISWHITESPACE(ch)  (map[ch] & BLANK)
 #define ISNEWLINE(ch)     (map[ch] & NEWLINE)
@@ -45,7 +53,7 @@ struct source source;
         fs->column = col + 1;                   \
     } while (0)
 
-#define MARK(t)  source = t->src
+#define MARK(t)  source = loc_source(t->loc)
 
 #define MARKC(fs)  do {                         \
         source.file = fs->name;                 \
@@ -77,8 +85,9 @@ const char *tok2s(struct token *t)
              t->id == ICONSTANT ||
              t->id == FCONSTANT)
         return TOK_LIT_STR(t);
-    else if (t->u.lit.str)
-        return t->u.lit.str;
+    else if ((t->id == LINENO || t->id == 0) && t->u.lit)
+        // line markers and header names
+        return TOK_LIT_STR(t);
     else
         return id2s(t->id);
 }
@@ -128,8 +137,7 @@ static void next_clean_line(struct buffer *pb)
     
     while (1) {
         // search '\n', '\\', '\r'
-        while (*s != '\n' && *s != '\\' && *s != '\r')
-            s++;
+        s = scan_line(s);
 
         c = *s;
         if (c == '\\')
@@ -181,15 +189,31 @@ static void next_clean_line(struct buffer *pb)
     pb->next_line = s + 1;
 }
 
-struct tokenrun *next_tokenrun(struct tokenrun *prev, unsigned int count)
+struct tokenrun *next_tokenrun(struct tokenrun *prev)
 {
     struct tokenrun *run = xmalloc(sizeof(struct tokenrun));
-    run->base = zmalloc(count * sizeof(struct token));
-    run->limit = run->base + count;
+    run->base = run->cur = xmalloc(TOKENRUN_SIZE);
+    run->limit = run->base + TOKENRUN_SIZE;
+    run->seq = prev ? prev->seq + 1 : 0;
     run->prev = prev;
     return run;
 }
 
+// zeroed memory of the current run
+static void *run_alloc(size_t size)
+{
+    struct tokenrun *run = cpp_file->tokenrun;
+    void *p;
+
+    // literals hold a long double
+    size = ROUNDUP(size, 16);
+    if (run->cur + size > run->limit)
+        run = cpp_file->tokenrun = next_tokenrun(run);
+    p = run->cur;
+    run->cur += size;
+    return memset(p, 0, size);
+}
+
 const char *ids(const char *name)
 {
     struct ident *ident;
@@ -201,21 +225,48 @@ const char *ids(const char *name)
 
 struct token *alloc_token(void)
 {
-    return zmalloc(sizeof(struct token));
+    return run_alloc(sizeof(struct token));
 }
 
-static struct token *copy_token(struct token *tok)
+// give back the last token allocated, if unused
+static void free_token(struct token *t)
 {
-    struct token *t = xmalloc(sizeof(struct token));
+    struct tokenrun *run = cpp_file->tokenrun;
+    size_t size = ROUNDUP(sizeof(struct token), 16);
+
+    if (run->cur == (char *)t + size)
+        run->cur -= size;
+}
+
+struct literal *alloc_literal(struct token *t)
+{
+    return t->u.lit = run_alloc(sizeof(struct literal));
+}
+
+// the literal is shared
+struct token *copy_token(struct token *tok)
+{
+    struct token *t = alloc_token();
     memcpy(t, tok, sizeof(struct token));
     return t;
 }
 
+// a copy that is never freed, for macro definitions
+struct token *perm_token(struct token *tok)
+{
+    struct token *t = NEWS0(struct token, PERM);
+    *t = *tok;
+    if (tok->id != ID && tok->u.lit) {
+        t->u.lit = NEWS0(struct literal, PERM);
+        *t->u.lit = *tok->u.lit;
+    }
+    return t;
+}
+
 static void line_comment(struct file *pfile)
 {
     struct buffer *pb = pfile->buffer;
-    while (*pb->cur != '\n')
-        pb->cur++;
+    pb->cur = scan_newline(pb->cur);
     process_line_notes(pb);
 }
 
@@ -228,6 +279,7 @@ static void block_comment(struct file *pfile)
     rpc++;
     
     for (;;) {
+        rpc = scan_comment(rpc);
         ch = *rpc++;
         if (ch == '/' && rpc[-2] == '*') {
             break;
@@ -333,13 +385,13 @@ static void float_constant(struct file *pfile, struct token *result)
     errno = 0;
     switch (suffix) {
     case FLOAT:
-        result->u.lit.v.d = strtof(s, NULL);
+        result->u.lit->v.d = strtof(s, NULL);
         break;
     case LONG + DOUBLE:
-        result->u.lit.v.d = strtold(s, NULL);
+        result->u.lit->v.d = strtold(s, NULL);
         break;
     default:
-        result->u.lit.v.d = strtod(s, NULL);
+        result->u.lit->v.d = strtod(s, NULL);
         break;
     }
 
@@ -347,8 +399,8 @@ static void float_constant(struct file *pfile, struct token *result)
         cpp_error("float constant overflow: %s", s);
 
     result->id = FCONSTANT;
-    result->u.lit.suffix = suffix;
-    result->u.lit.str = s;
+    result->u.lit->suffix = suffix;
+    result->u.lit->str = s;
     pb->cur = pc;
 }
 
@@ -438,10 +490,10 @@ static void integer_constant(struct file *pfile, struct token *result)
         cpp_error("integer constant overflow: %s", s);
 
     result->id = ICONSTANT;
-    result->u.lit.base = base;
-    result->u.lit.suffix = suffix;
-    result->u.lit.v.u = n;
-    result->u.lit.str = s;
+    result->u.lit->base = base;
+    result->u.lit->suffix = suffix;
+    result->u.lit->v.u = n;
+    result->u.lit->str = s;
     pb->cur = pc;
 }
 
@@ -451,6 +503,7 @@ static void number(struct file *pfile, struct token *result)
     struct buffer *pb = pfile->buffer;
     const unsigned char *pc = pb->cur - 1;
 
+    alloc_literal(result);
     if (pc[0] == '.') {
         float_constant(pfile, result);
     } else if (pc[0] == '0' && (pc[1] == 'x' || pc[1] == 'X')) {
@@ -510,8 +563,9 @@ static void string_constant(struct file *pfile,
         cpp_error("untermiated string constant: \"%s\"", name);
     
     result->id = SCONSTANT;
-    result->u.lit.str = name;
-    result->u.lit.wide = wide;
+    alloc_literal(result);
+    result->u.lit->str = name;
+    result->u.lit->wide = wide;
 }
 
 static unsigned int escape(const unsigned char **pc)
@@ -660,9 +714,10 @@ static void char_constant(struct file *pfile,
         cpp_error("illegal multi-character sequence");
     
     result->id = ICONSTANT;
-    result->u.lit.v.u = wide ? (wchar_t)c : (unsigned char)c;
-    result->u.lit.wide = wide;
-    result->u.lit.str = s;
+    alloc_literal(result);
+    result->u.lit->v.u = wide ? (wchar_t)c : (unsigned char)c;
+    result->u.lit->wide = wide;
+    result->u.lit->str = s;
     pb->cur = pc;
 }
 
@@ -672,277 +727,301 @@ static struct ident *identifier(struct file *pfile)
     const unsigned char *rpc = pb->cur - 1;
     unsigned int len;
 
-    while (ISDIGITLETTER(*pb->cur))
-        pb->cur++;
-
+    pb->cur = scan_ident(pb->cur);
     len = pb->cur - rpc;
     return idtab_lookup(pfile->idtab,
                         (const char *)rpc, len, ID_CREATE);
 }
 
-static struct token *dolex(struct file *pfile)
+/**
+ * The hand-written recognizer the tables replaced, kept
+ * for -flexer=switch to test one against the other.
+ */
+static int switch_punctuator(struct buffer *pb, const unsigned char *rpc)
 {
-    register const unsigned char *rpc;
-    struct token *result;
-    struct buffer *pb = pfile->buffer;
-
-    if (pb->need_line)
-        next_clean_line(pb);
-    // pb->buf maybe NULL
-    if (pb->cur >= pb->limit)
-        return eoi_token;
-
-    if (pfile->cur_token == pfile->tokenrun->limit) {
-        pfile->tokenrun = next_tokenrun(pfile->tokenrun, 1024);
-        pfile->cur_token = pfile->tokenrun->base;
-    }
-    result = pfile->cur_token++;
-    
- start:
-    if (pb->cur >= pb->notes[pb->cur_note].pos)
-        process_line_notes(pb);
-    SET_COLUMN(pb, pb->cur - pb->line_base);
-    rpc = pb->cur++;
-    MARKC(pb);
+    int id;
 
     switch (*rpc) {
-    case '\n':
-        if (rpc >= pb->limit) {
-            pfile->cur_token--;
-            return eoi_token;
-        } else {
-            pb->need_line = true;
-            pb->bol = true;
-            newline_token->src = source;
-            INCLINE(pb, 0);
-            pfile->cur_token--;
-            return newline_token;
-        }
-
-        // spaces
-    case '\t':
-    case '\v':
-    case '\f':
-    case '\r':
-    case ' ':
-        do
-            rpc++;
-        while (ISWHITESPACE(*rpc));
-        pb->cur = rpc;
-        space_token->src = source;
-        pfile->cur_token--;
-        return space_token;
-
-        // punctuators
     case '/':
-        if (rpc[1] == '/') {
-            line_comment(pfile);
-            goto start;
-        } else if (rpc[1] == '*') {
-            block_comment(pfile);
-            goto start;
-        } else if (rpc[1] == '=') {
+        if (rpc[1] == '=') {
             pb->cur++;
-            result->id = DIVEQ;
+            id = DIVEQ;
         } else {
-            result->id = '/';
+            id = '/';
         }
         break;
 
     case '+':
         if (rpc[1] == '+') {
             pb->cur++;
-            result->id = INCR;
+            id = INCR;
         } else if (rpc[1] == '=') {
             pb->cur++;
-            result->id = ADDEQ;
+            id = ADDEQ;
         } else {
-            result->id = '+';
+            id = '+';
         }
         break;
 
     case '-':
         if (rpc[1] == '-') {
             pb->cur++;
-            result->id = DECR;
+            id = DECR;
         } else if (rpc[1] == '=') {
             pb->cur++;
-            result->id = MINUSEQ;
+            id = MINUSEQ;
         } else if (rpc[1] == '>') {
             pb->cur++;
-            result->id = DEREF;
+            id = DEREF;
         } else {
-            result->id = '-';
+            id = '-';
         }
         break;
 
     case '*':
         if (rpc[1] == '=') {
             pb->cur++;
-            result->id = MULEQ;
+            id = MULEQ;
         } else {
-            result->id = '*';
+            id = '*';
         }
         break;
 
     case '=':
         if (rpc[1] == '=') {
             pb->cur++;
-            result->id = EQL;
+            id = EQL;
         } else {
-            result->id = '=';
+            id = '=';
         }
         break;
 
     case '!':
         if (rpc[1] == '=') {
             pb->cur++;
-            result->id = NEQ;
+            id = NEQ;
         } else {
-            result->id = '!';
+            id = '!';
         }
         break;
 
     case '%':
         if (rpc[1] == '=') {
             pb->cur++;
-            result->id = MODEQ;
+            id = MODEQ;
         } else if (rpc[1] == '>') {
             pb->cur++;
-            result->id = '}';
+            id = '}';
         } else if (rpc[1] == ':' && rpc[2] == '%' && rpc[3] == ':') {
             pb->cur += 3;
-            result->id = SHARPSHARP;
+            id = SHARPSHARP;
         } else if (rpc[1] == ':') {
             pb->cur++;
-            result->id = '#';
+            id = '#';
         } else {
-            result->id = '%';
+            id = '%';
         }
         break;
 
     case '^':
         if (rpc[1] == '=') {
             pb->cur++;
-            result->id = XOREQ;
+            id = XOREQ;
         } else {
-            result->id = '^';
+            id = '^';
         }
         break;
 
     case '&':
         if (rpc[1] == '=') {
             pb->cur++;
-            result->id = BANDEQ;
+            id = BANDEQ;
         } else if (rpc[1] == '&') {
             pb->cur++;
-            result->id = ANDAND;
+            id = ANDAND;
         } else {
-            result->id = '&';
+            id = '&';
         }
         break;
 
     case '|':
         if (rpc[1] == '=') {
             pb->cur++;
-            result->id = BOREQ;
+            id = BOREQ;
         } else if (rpc[1] == '|') {
             pb->cur++;
-            result->id = OROR;
+            id = OROR;
         } else {
-            result->id = '|';
+            id = '|';
         }
         break;
 
     case '<':
         if (rpc[1] == '=') {
             pb->cur++;
-            result->id = LEQ;
+            id = LEQ;
         } else if (rpc[1] == '<' && rpc[2] == '=') {
             pb->cur += 2;
-            result->id = LSHIFTEQ;
+            id = LSHIFTEQ;
         } else if (rpc[1] == '<') {
             pb->cur++;
-            result->id = LSHIFT;
+            id = LSHIFT;
         } else if (rpc[1] == '%') {
             pb->cur++;
-            result->id = '{';
+            id = '{';
         } else if (rpc[1] == ':') {
             pb->cur++;
-            result->id = '[';
+            id = '[';
         } else {
-            result->id = '<';
+            id = '<';
         }
         break;
 
     case '>':
         if (rpc[1] == '=') {
             pb->cur++;
-            result->id = GEQ;
+            id = GEQ;
         } else if (rpc[1] == '>' && rpc[2] == '=') {
             pb->cur += 2;
-            result->id = RSHIFTEQ;
+            id = RSHIFTEQ;
         } else if (rpc[1] == '>') {
             pb->cur++;
-            result->id = RSHIFT;
+            id = RSHIFT;
         } else {
-            result->id = '>';
+            id = '>';
         }
         break;
 
-    case '(': case ')':
-    case '{': case '}':
-    case '[': case ']':
-    case ',': case ';':
-    case '~': case '?':
-        result->id = *rpc;
+    case '.':
+        if (rpc[1] == '.' && rpc[2] == '.') {
+            pb->cur += 2;
+            id = ELLIPSIS;
+        } else {
+            id = '.';
+        }
+        break;
+
+    default:
+        id = *rpc;
         break;
 
     case ':':
         if (rpc[1] == '>') {
             pb->cur++;
-            result->id = ']';
+            id = ']';
         } else {
-            result->id = ':';
+            id = ':';
         }
         break;
 
     case '#':
         if (rpc[1] == '#') {
             pb->cur++;
-            result->id = SHARPSHARP;
+            id = SHARPSHARP;
         } else {
-            result->id = '#';
+            id = '#';
+        }
+        break;
+    }
+    return id;
+}
+
+static struct token *dolex(struct file *pfile)
+{
+    register const unsigned char *rpc;
+    struct token *result;
+    struct buffer *pb = pfile->buffer;
+
+    if (pb->need_line)
+        next_clean_line(pb);
+    // pb->buf maybe NULL
+    if (pb->cur >= pb->limit)
+        return eoi_token;
+
+    result = alloc_token();
+    
+ start:
+    if (pb->cur >= pb->notes[pb->cur_note].pos)
+        process_line_notes(pb);
+    SET_COLUMN(pb, pb->cur - pb->line_base);
+    rpc = pb->cur++;
+    MARKC(pb);
+
+    switch (lex_class[*rpc]) {
+    case LC_NEWLINE:
+        free_token(result);
+        if (rpc >= pb->limit) {
+            return eoi_token;
+        } else {
+            pb->need_line = true;
+            pb->bol = true;
+            newline_token->loc = make_loc(source.file, source.line, source.column);
+            INCLINE(pb, 0);
+            return newline_token;
+        }
+
+    case LC_SPACE:
+        do
+            rpc++;
+        while (ISWHITESPACE(*rpc));
+        pb->cur = rpc;
+        space_token->loc = make_loc(source.file, source.line, source.column);
+        free_token(result);
+        return space_token;
+
+        // punctuators, the longest by the tables of mklex
+    case LC_SINGLE:
+        result->id = *rpc;
+        break;
+
+    case LC_SLASH:
+        if (rpc[1] == '/') {
+            line_comment(pfile);
+            goto start;
+        } else if (rpc[1] == '*') {
+            block_comment(pfile);
+            goto start;
+        }
+        goto punct;
+
+    case LC_DOT:
+        if (ISDIGIT(rpc[1])) {
+            number(pfile, result);
+            break;
+        }
+        // go through
+    case LC_PUNCT:
+    punct:
+        if (lex_switch) {
+            result->id = switch_punctuator(pb, rpc);
+        } else {
+            const unsigned char *p = rpc;
+            unsigned int s = LEX_START;
+
+            while ((s = lex_next[s][lex_pclass[*p++]])) {
+                if (lex_accept[s]) {
+                    result->id = lex_accept[s];
+                    pb->cur = p;
+                }
+            }
         }
         break;
 
         // constants
-    case '\'':
+    case LC_CHAR:
         char_constant(pfile, result, false);
         break;
 
-    case '"':
+    case LC_STRING:
         string_constant(pfile, result, false);
         break;
 
-    case '0': case '1': case '2': case '3': case '4':
-    case '5': case '6': case '7': case '8': case '9':
+    case LC_DIGIT:
         number(pfile, result);
         break;
 
-    case '.':
-        if (rpc[1] == '.' && rpc[2] == '.') {
-            pb->cur += 2;
-            result->id = ELLIPSIS;
-        } else if (ISDIGIT(rpc[1])) {
-            number(pfile, result);
-        } else {
-            result->id = '.';
-        }
-        break;
-
         // identifiers
-    case 'L':
+    case LC_WIDE:
         if (rpc[1] == '\'') {
             char_constant(pfile, result, true);
             break;
@@ -951,17 +1030,7 @@ static struct token *dolex(struct file *pfile)
             break;
         }
         // go through
-    case '_':
-    case 'a': case 'b': case 'c': case 'd': case 'e': case 'f':
-    case 'g': case 'h': case 'i': case 'j': case 'k': case 'l':
-    case 'm': case 'n': case 'o': case 'p': case 'q': case 'r':
-    case 's': case 't': case 'u': case 'v': case 'w': case 'x':
-    case 'y': case 'z':
-    case 'A': case 'B': case 'C': case 'D': case 'E': case 'F':
-    case 'G': case 'H': case 'I': case 'J': case 'K':
-    case 'M': case 'N': case 'O': case 'P': case 'Q': case 'R':
-    case 'S': case 'T': case 'U': case 'V': case 'W': case 'X':
-    case 'Y': case 'Z':
+    case LC_IDENT:
         result->id = ID;
         result->u.ident = identifier(pfile);
         break;
@@ -976,7 +1045,8 @@ static struct token *dolex(struct file *pfile)
     }
 
     // done
-    result->src = source;
+    cpp_counts.tokens++;
+    result->loc = make_loc(source.file, source.line, source.column);
     result->bol = pb->bol;
     pb->bol = false;
     return result;
@@ -1031,13 +1101,13 @@ struct token *header_name(struct file *pfile)
     if (ch == '<') {
         const char *name = hq_char_sequence(pfile, '>');
         struct token *t = alloc_token();
-        t->u.lit.str = name;
+        alloc_literal(t)->str = name;
         t->kind = ch;
         return t;
     } else if (ch == '"') {
         const char *name = hq_char_sequence(pfile, '"');
         struct token *t = alloc_token();
-        t->u.lit.str = name;
+        alloc_literal(t)->str = name;
         t->kind = ch;
         return t;
     } else {
@@ -1047,7 +1117,60 @@ struct token *header_name(struct file *pfile)
     }
 }
 
+// skip a string or character literal, 'p' points to the quote.
+static const unsigned char *skip_literal(const unsigned char *p)
+{
+    int sep = *p++;
+
+    while (*p != sep && *p != '\n') {
+        if (*p == '\\' && p[1] != '\n')
+            p++;
+        p++;
+    }
+    return *p == sep ? p + 1 : p;
+}
+
+// skip the rest of a line in a skipped group
+static void skip_rest(struct file *pfile)
+{
+    struct buffer *pb = pfile->buffer;
+    const unsigned char *p = pb->cur;
+
+    for (;;) {
+        p = scan_skip(p);
+        if (*p == '\n') {
+            break;
+        } else if (*p == '/') {
+            if (p[1] == '/') {
+                p = scan_newline(p);
+                break;
+            } else if (p[1] == '*') {
+                pb->cur = p + 1;
+                block_comment(pfile);
+                p = pb->cur;
+            } else {
+                p++;
+            }
+        } else {
+            p = skip_literal(p);
+        }
+    }
+
+    pb->cur = p;
+    process_line_notes(pb);
+    if (p < pb->limit) {
+        pb->need_line = true;
+        pb->bol = true;
+        INCLINE(pb, 0);
+    }
+}
+
 /* Skip part of conditional group.
+ *
+ * Only directives matter there, so a line is scanned for
+ * the comments and literals that may hide its end or the
+ * next line's '#' (or '%:'), and only directive lines are
+ * lexed.
  */
 void skip_ifstack(struct file *pfile)
 {
@@ -1055,38 +1178,78 @@ void skip_ifstack(struct file *pfile)
     int nest = 0;
     assert(vec_len(pb->ungets) == 0);
     for (;;) {
-        struct token *t0 = dolex(pfile);
-        if (t0->id == EOI)
+        unsigned int line = pb->line;
+        if (pb->need_line)
+            next_clean_line(pb);
+        // pb->buf maybe NULL
+        if (pb->cur >= pb->limit)
             break;
-        if (t0->id != '#' || !t0->bol)
+        if (pb->bol) {
+            const unsigned char *p = pb->cur;
+            for (;;) {
+                while (ISWHITESPACE(*p))
+                    p++;
+                if (p[0] != '/' || p[1] != '*')
+                    break;
+                pb->cur = p + 1;
+                block_comment(pfile);
+                p = pb->cur;
+            }
+            pb->cur = p;
+        }
+        if (!pb->bol || (pb->cur[0] != '#' &&
+                         (pb->cur[0] != '%' || pb->cur[1] != ':'))) {
+            skip_rest(pfile);
+            skip_stats.fast += pb->line - line;
             continue;
+        }
+        struct token *t0 = dolex(pfile);
         struct token *t = dolex(pfile);
         while (IS_SPACE(t))
             t = dolex(pfile);
-        if (t->id != ID)
-            continue;
-        const char *name = TOK_ID_STR(t);
-        if (!strcmp(name, "if") ||
-            !strcmp(name, "ifdef") ||
-            !strcmp(name, "ifndef")) {
-            nest++;
+        if (IS_NEWLINE(t) || t->id == EOI) {
+            skip_stats.lexed += pb->line - line;
             continue;
         }
-        if (!nest &&
-            (!strcmp(name, "elif") ||
-             !strcmp(name, "else") ||
-             !strcmp(name, "endif"))) {
-            // found
-            unget(pfile, t);
-            unget(pfile, t0);
-            break;
+        if (t->id == ID) {
+            const char *name = TOK_ID_STR(t);
+            if (!strcmp(name, "if") ||
+                !strcmp(name, "ifdef") ||
+                !strcmp(name, "ifndef")) {
+                nest++;
+            } else if (!nest &&
+                       (!strcmp(name, "elif") ||
+                        !strcmp(name, "else") ||
+                        !strcmp(name, "endif"))) {
+                // found
+                skip_stats.lexed += pb->line - line + 1;
+                unget(pfile, t);
+                unget(pfile, t0);
+                break;
+            } else if (nest && !strcmp(name, "endif")) {
+                nest--;
+            }
         }
-        if (nest && !strcmp(name, "endif"))
-            nest--;
-        skipline(pfile, false);
+        skip_rest(pfile);
+        skip_stats.lexed += pb->line - line;
     }
 }
 
+// called when a unit starts
+void lex_begin(void)
+{
+    // expansions add to the hidesets of the static tokens
+    eoi_token->hideset = newline_token->hideset = space_token->hideset = NULL;
+    memset(&skip_stats, 0, sizeof(skip_stats));
+    lex_switch = false;
+}
+
+void lex_dump(void)
+{
+    dlog("skip: %u lines scanned, %u lexed.",
+         skip_stats.fast, skip_stats.lexed);
+}
+
 struct token *lex(struct file *pfile)
 {
     struct vector *v = pfile->buffer->ungets;
@@ -1134,12 +1297,13 @@ static struct token *combine_scons(struct token **v, size_t len)
         const char *name = TOK_LIT_STR(t);
         strcpy(bp, name);
         bp += strlen(name);
-        if (t->u.lit.wide)
+        if (t->u.lit->wide)
             wide = true;
     }
 
-    t0->u.lit.str = strs(s);
-    t0->u.lit.wide = wide;
+    *alloc_literal(t0) = *v[0]->u.lit;
+    t0->u.lit->str = strs(s);
+    t0->u.lit->wide = wide;
     free(s);
     return t0;
 }
@@ -1170,22 +1334,6 @@ static int kinds[] = {
 #include "token.def"
 };
 
-static const char *kws[] = {
-#define _a(a, b, c, d)
-#define _x(a, b, c, d)
-#define _t(a, b, c)
-#define _k(a, b, c)  b,
-#include "token.def"
-};
-
-static int kwi[] = {
-#define _a(a, b, c, d)
-#define _x(a, b, c, d)
-#define _t(a, b, c)
-#define _k(a, b, c)  a,
-#include "token.def"
-};
-
 struct token *token;
 struct token *ahead_token;
 
@@ -1204,16 +1352,9 @@ static int tkind(int t)
 static struct token *get_cc_token(struct file *pfile)
 {
     struct token *t = do_get_cc_token(pfile);
-    // keywords
-    if (t->id == ID) {
-        const char *name = TOK_ID_STR(t);
-        for (int i = 0; i < ARRAY_SIZE(kws); i++) {
-            if (!strcmp(name, kws[i])) {
-                t->id = kwi[i];
-                break;
-            }
-        }
-    }
+    // keywords, classified when interned
+    if (t->id == ID && t->u.ident->keyword)
+        t->id = t->u.ident->keyword;
     // set kind finally
     t->kind = tkind(t->id);
     return t;
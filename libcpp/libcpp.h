@@ -30,31 +30,56 @@ enum {
 
 // token
 #define TOK_ID_STR(t)    ((t)->u.ident->str)
-#define TOK_LIT_STR(t)   ((t)->u.lit.str)
+#define TOK_LIT_STR(t)   ((t)->u.lit->str)
+#define TOK_SRC(t)       loc_source((t)->loc)
+
+// string/number literal, kept aside of the token
+struct literal {
+    const char *str;            // literal lexeme
+    bool wide;                  // wide string
+    char base;                  // 0:dec, 8:Oct, 16:hex
+    int suffix;
+    union value v;
+};
+
+/**
+ * A string interned by strtab.c follows its hash and
+ * length, so that the tables keyed by one need not hash
+ * it again.
+ */
+struct string {
+    unsigned int hash;
+    unsigned int len;
+    char str[];
+};
+
+#define STR_HASH(s)  (((const struct string *)(s) - 1)->hash)
+#define STR_LEN(s)   (((const struct string *)(s) - 1)->len)
 
+/**
+ * Tokens are 32 bytes: the location is a handle (see
+ * loc.c), and literals point to their payload. They are
+ * allocated from the token runs of the file.
+ */
 struct token {
     unsigned short id;
     unsigned short kind;
-    bool bol;                // beginning of line
-    bool space;              // leading space
-    bool param;              // macro param
-    unsigned int pos;        // param posistion
-    struct source src;
+    bool bol:1;              // beginning of line
+    bool space:1;            // leading space
+    bool param:1;            // macro param
+    unsigned short pos;      // param posistion
+    unsigned long long loc;  // source location
     struct hideset *hideset;
     union {
         // identifier
         struct ident *ident;
-        // string/number literal
-        struct {
-            const char *str;    // literal lexeme
-            bool wide;          // wide string
-            char base;          // 0:dec, 8:Oct, 16:hex
-            int suffix;
-            union value v;
-        } lit;
+        // literal, or the text of other tokens (NULL if none)
+        struct literal *lit;
     } u;
 };
 
+struct header;
+
 // The file read by preprocessor.
 struct file {
     const char *file;           // file name
@@ -64,18 +89,22 @@ struct file {
     struct vector *std_include_paths;
     struct vector *usr_include_paths;
     struct tokenrun *tokenrun;
-    struct token *cur_token;
     const char *date;            // current date string (quoted)
     const char *time;            // current time string (quoted)
+    struct vector *units;       // inputs after 'file' (-funity)
+    int next_unit;
+    struct header **headers;    // include guards by path
+    unsigned int nheaders;
+    struct token *pch_tokens;   // precompiled header tokens left
+    struct token *pch_end;
     unsigned int errors, warnings;
 };
 
 // An identifier
 struct ident {
-    unsigned int hash;
-    unsigned int len;
-    const char *str;
+    const char *str;            // interned, see STR_HASH()
     int type:8;
+    unsigned short keyword;     // token id if a keyword, or 0
     union {
         struct macro *macro;
     } u;
@@ -88,11 +117,39 @@ struct ident {
 
 // cpp.c
 extern void cpp_init(int argc, char *argv[]);
+extern void cpp_release_tokens(void);
+extern void cpp_finish(void);
 extern struct token *get_pptok(struct file *pfile);
+extern void (*cpp_unit_handler)(const char *prev); // called between unity inputs
+extern void cpp_scan(struct file *pfile);
+
+// deps.c
+extern void cpp_write_deps(void);
+extern void cpp_write_report(void);
+
+// pch.c
+extern void cpp_emit_pch(struct file *pfile, FILE *fp);
+
+// cache.c
+extern void cpp_cache_init(void);
+
+// error.c
+extern void (*cpp_fatal_handler)(void); // called before exit on fatal errors
 
 // input.c
 extern void cpp_dump(struct file *pfile);
 
+// loc.c
+extern struct source loc_source(unsigned long long loc);
+
+// strtab.c
+extern char *strs(const char *);
+extern char *strn(const char *, size_t);
+extern char *strnh(const char *, size_t, unsigned int);
+extern const char *strfind(const char *, size_t, unsigned int);
+extern char *strd(long);
+extern char *stru(unsigned long);
+
 // lex.c
 extern const char *id2s(int t);
 extern const char *tok2s(struct token *t);
@@ -106,9 +163,9 @@ extern const char *ids(const char *name);
 #define token_is_not(t)  (token->id != (t))
 #define next_token_is(t)  (lookahead()->id == (t))
 #define is_char_cnst(t)  ((t)->id == ICONSTANT && \
-                          (t)->u.lit.str && \
-                          (t)->u.lit.str[0] == '\'' && \
-                          (t)->u.lit.str[0] == 'L')
+                          TOK_LIT_STR(t) && \
+                          TOK_LIT_STR(t)[0] == '\'' && \
+                          TOK_LIT_STR(t)[0] == 'L')
 #define is_assign_tok(t)    ((t)->id == '=' || (t)->kind == ADDEQ)
 
 ///
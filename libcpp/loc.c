@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include "internal.h"
+#include "libutils.h"
+
+/**
+ * Source locations of tokens.
+ *
+ * A location is a 64-bit handle: the index of a (file,
+ * line) entry in the line table, and the column in the
+ * low bits. It takes the padding after the small fields
+ * of a token, so a unit has no limit on its lines but
+ * the memory of the table. Tokens of a line share the
+ * entry, so a new one is added only when the lexer moves
+ * to another line or file. Columns past LOC_MAX_COLUMN
+ * are clamped.
+ *
+ * Location 0 is the entry of no file, like a zeroed
+ * 'struct source'. The table lives as long as the unit.
+ */
+
+struct line_entry {
+    const char *file;
+    unsigned int line;
+};
+
+static struct line_entry *lines;
+static unsigned int nlines, alloc_lines;
+
+// called when a unit starts
+void loc_begin(void)
+{
+    free(lines);
+    alloc_lines = 1024;
+    lines = xmalloc(alloc_lines * sizeof(struct line_entry));
+    lines[0] = (struct line_entry){ NULL, 0 };
+    nlines = 1;
+}
+
+// the first location of 'n' new entries
+unsigned long long loc_reserve(unsigned int n)
+{
+    unsigned long long first = nlines;
+
+    if (nlines + n > alloc_lines) {
+        alloc_lines = (nlines + n) * 2;
+        lines = xrealloc(lines, alloc_lines * sizeof(struct line_entry));
+    }
+    nlines += n;
+    return first << LOC_COLUMN_BITS;
+}
+
+void loc_set_line(unsigned long long loc, const char *file, unsigned int line)
+{
+    lines[loc >> LOC_COLUMN_BITS] = (struct line_entry){ file, line };
+}
+
+unsigned long long make_loc(const char *file, unsigned int line,
+                            unsigned int column)
+{
+    struct line_entry *last = &lines[nlines - 1];
+    unsigned long long loc;
+
+    if (column > LOC_MAX_COLUMN)
+        column = LOC_MAX_COLUMN;
+    if (last->line == line && last->file == file)
+        return ((unsigned long long)(nlines - 1) << LOC_COLUMN_BITS) | column;
+
+    loc = loc_reserve(1);
+    loc_set_line(loc, file, line);
+    return loc | column;
+}
+
+struct source loc_source(unsigned long long loc)
+{
+    struct line_entry *e = &lines[loc >> LOC_COLUMN_BITS];
+    return (struct source){ e->line, loc & LOC_MAX_COLUMN, e->file };
+}
+
+// the number of entries, for a precompiled header
+unsigned int loc_lines(void)
+{
+    return nlines;
+}
+
+void loc_dump(void)
+{
+    dlog("loc: %u lines, %lu bytes.",
+         nlines, (unsigned long)alloc_lines * sizeof(struct line_entry));
+}
@@ -0,0 +1,513 @@
+#include "config.h"
+#include "compat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "internal.h"
+#include "libutils.h"
+
+/**
+ * Precompiled headers (-emit-pch, -include-pch).
+ *
+ * The image keeps what preprocessing the header leaves
+ * behind: the macro table, the include guards and the
+ * expanded tokens the parser reads. Loading it replays
+ * those tokens instead of reading, lexing and expanding
+ * the header again; the declarations are still parsed.
+ *
+ * The image is mapped once and relocated in place: the
+ * pointers are written as file offsets, and identifiers
+ * as names to intern again. It is only used if it was
+ * made by the same compiler with the same -D, -U and -I
+ * options, and none of its files changed since.
+ *
+ *   header
+ *   files      path, mtime, size
+ *   headers    path, guard, #pragma once
+ *   macros     name, struct macro
+ *   slots      params/body of the macros, token indexes
+ *   tokens     macro tokens, then the stream
+ *   lines      line table of the token locations
+ *   literals, strings
+ */
+
+#define PCH_MAGIC  "9ccpch3"
+#define NSTRINGS   4096
+
+struct pch_header {
+    char magic[8];
+    uint32_t key;               // version and options
+    uint32_t source;            // the header
+    uint32_t nfiles, files;
+    uint32_t nheaders, headers;
+    uint32_t nmacros, macros;
+    uint32_t slots;
+    uint32_t ntokens, tokens;
+    uint32_t stream;            // first token of the stream
+    uint32_t nlines, lines;
+    uint32_t size;
+};
+
+struct pch_file {
+    uint32_t path;
+    uint32_t sys;
+    int64_t mtime, mtime_nsec;
+    int64_t size;
+};
+
+struct pch_hdr {
+    uint32_t path;
+    uint32_t guard;             // 0 if none
+    uint32_t once;
+};
+
+struct pch_line {
+    uint32_t file;
+    uint32_t line;
+};
+
+struct pch_macro {
+    uint32_t name;
+    struct macro m;
+};
+
+// the image being written
+struct image {
+    char *buf;
+    size_t len, alloc;
+    struct sentry *strings[NSTRINGS];
+};
+
+struct sentry {
+    const char *str;
+    uint32_t off;
+    struct sentry *link;
+};
+
+static const char *pch_key;
+static void *map_base;
+static size_t map_len;
+static struct {
+    const char *status;
+    unsigned int nmacros;
+    unsigned int ntokens;
+} stats;
+
+// called when a unit starts with its -D, -U and -I options
+void pch_begin(const char *options)
+{
+    free((void *)pch_key);
+    pch_key = format("%s\n%s", VERSION, options);
+    memset(&stats, 0, sizeof(stats));
+}
+
+void pch_end(void)
+{
+    if (map_base)
+        munmap(map_base, map_len);
+    map_base = NULL;
+    map_len = 0;
+}
+
+/// write
+
+static uint32_t put(struct image *img, const void *data, size_t len)
+{
+    // the literals hold a long double
+    size_t off = ROUNDUP(img->len, 16);
+
+    if (off + len > img->alloc) {
+        img->alloc = (off + len) * 2 + 4096;
+        img->buf = xrealloc(img->buf, img->alloc);
+    }
+    memset(img->buf + img->len, 0, off - img->len);
+    if (data)
+        memcpy(img->buf + off, data, len);
+    else
+        memset(img->buf + off, 0, len);
+    img->len = off + len;
+    return off;
+}
+
+static uint32_t put_string(struct image *img, const char *s)
+{
+    unsigned int h;
+    struct sentry *p;
+    size_t len, off;
+
+    if (s == NULL)
+        return 0;
+    h = strhash(s) & (NSTRINGS - 1);
+    for (p = img->strings[h]; p; p = p->link)
+        if (!strcmp(p->str, s))
+            return p->off;
+
+    // unaligned
+    len = strlen(s) + 1;
+    off = img->len;
+    if (off + len > img->alloc) {
+        img->alloc = (off + len) * 2 + 4096;
+        img->buf = xrealloc(img->buf, img->alloc);
+    }
+    memcpy(img->buf + off, s, len);
+    img->len += len;
+
+    p = zmalloc(sizeof(struct sentry));
+    p->str = s;
+    p->off = off;
+    p->link = img->strings[h];
+    img->strings[h] = p;
+    return off;
+}
+
+#define AT(img, type, off)  ((type *)((img)->buf + (off)))
+
+static void put_token(struct image *img, uint32_t off, struct token *t)
+{
+    struct token tok = *t;
+
+    tok.hideset = NULL;
+    if (t->id == ID) {
+        tok.u.ident = (struct ident *)(uintptr_t)put_string(img, t->u.ident->str);
+    } else if (t->u.lit) {
+        struct literal lit = *t->u.lit;
+        lit.str = (const char *)(uintptr_t)put_string(img, lit.str);
+        tok.u.lit = (struct literal *)(uintptr_t)put(img, &lit, sizeof(lit));
+    }
+    *AT(img, struct token, off) = tok;
+}
+
+static int cmp_header(const void *a, const void *b)
+{
+    const struct header *h1 = *(const struct header **)a;
+    const struct header *h2 = *(const struct header **)b;
+    return h1->seq < h2->seq ? -1 : h1->seq > h2->seq;
+}
+
+static int collect_macro(struct idtab *t, struct ident *id, const void *v)
+{
+    if (id->type == CT_MACRO && id->u.macro->kind != MACRO_SPECIAL)
+        vec_push((struct vector *)v, id);
+    return 0;
+}
+
+/**
+ * Preprocess the whole input and write the image to
+ * 'fp'. Nothing is written if there are errors.
+ */
+void cpp_emit_pch(struct file *pfile, FILE *fp)
+{
+    struct image img = { 0 };
+    struct vector *stream = vec_new();
+    struct vector *macros = vec_new();
+    struct vector *files = vec_new();
+    struct pch_header h;
+    size_t nslots = 0, ntokens;
+    uint32_t slot, tok;
+    struct token *t;
+
+    for (t = get_pptok(pfile); t->id != EOI; t = get_pptok(pfile))
+        vec_push(stream, t);
+    if (pfile->errors)
+        return;
+
+    idtab_foreach(pfile->idtab, collect_macro, macros);
+    ntokens = vec_len(stream);
+    for (size_t i = 0; i < vec_len(macros); i++) {
+        struct macro *m = ((struct ident *)vec_at(macros, i))->u.macro;
+        nslots += m->nparams + m->nbody;
+    }
+    ntokens += nslots;
+
+    for (int i = 0; i < NHEADERS; i++)
+        for (struct header *p = pfile->headers[i]; p; p = p->link)
+            vec_push(files, p);
+    qsort(files->mem, vec_len(files), sizeof(void *), cmp_header);
+
+    memset(&h, 0, sizeof(h));
+    put(&img, NULL, sizeof(h));
+    h.nfiles = vec_len(files) + 1;
+    h.files = put(&img, NULL, h.nfiles * sizeof(struct pch_file));
+    h.nheaders = vec_len(files);
+    h.headers = put(&img, NULL, h.nheaders * sizeof(struct pch_hdr));
+    h.nmacros = vec_len(macros);
+    h.macros = put(&img, NULL, h.nmacros * sizeof(struct pch_macro));
+    h.slots = put(&img, NULL, nslots * sizeof(uintptr_t));
+    h.ntokens = ntokens;
+    h.tokens = put(&img, NULL, ntokens * sizeof(struct token));
+    h.stream = nslots;
+    // entry 0 is no file
+    h.nlines = loc_lines() - 1;
+    h.lines = put(&img, NULL, h.nlines * sizeof(struct pch_line));
+
+    // the header itself, then everything it includes
+    for (size_t i = 0; i < h.nfiles; i++) {
+        struct pch_file *f;
+        struct stat st;
+        const char *path = i ? ((struct header *)vec_at(files, i - 1))->path :
+            pfile->file;
+        uint32_t off = put_string(&img, path);
+        f = AT(&img, struct pch_file, h.files) + i;
+        f->path = off;
+        f->sys = i ? ((struct header *)vec_at(files, i - 1))->sys : false;
+        if (stat(path, &st) == 0) {
+            f->mtime = ST_MTIM(&st).tv_sec;
+            f->mtime_nsec = ST_MTIM(&st).tv_nsec;
+            f->size = st.st_size;
+        }
+    }
+    for (size_t i = 0; i < h.nlines; i++) {
+        struct source src = loc_source((i + 1) << LOC_COLUMN_BITS);
+        uint32_t file = put_string(&img, src.file);
+        AT(&img, struct pch_line, h.lines)[i].file = file;
+        AT(&img, struct pch_line, h.lines)[i].line = src.line;
+    }
+    for (size_t i = 0; i < h.nheaders; i++) {
+        struct header *p = vec_at(files, i);
+        uint32_t path = put_string(&img, p->path);
+        uint32_t guard = p->guard ? put_string(&img, p->guard->str) : 0;
+        struct pch_hdr *r = AT(&img, struct pch_hdr, h.headers) + i;
+        r->path = path;
+        r->guard = guard;
+        r->once = p->once;
+    }
+
+    slot = h.slots;
+    tok = 0;
+    for (size_t i = 0; i < h.nmacros; i++) {
+        struct ident *id = vec_at(macros, i);
+        struct macro m = *id->u.macro;
+        uint32_t name = put_string(&img, id->str);
+        uint32_t file = put_string(&img, m.src.file);
+
+        m.src.file = (const char *)(uintptr_t)file;
+        m.params = (struct token **)(uintptr_t)slot;
+        for (unsigned int j = 0; j < m.nparams; j++, tok++) {
+            put_token(&img, h.tokens + tok * sizeof(struct token),
+                      id->u.macro->params[j]);
+            *AT(&img, uintptr_t, slot) = tok;
+            slot += sizeof(uintptr_t);
+        }
+        m.body = (struct token **)(uintptr_t)slot;
+        for (unsigned int j = 0; j < m.nbody; j++, tok++) {
+            put_token(&img, h.tokens + tok * sizeof(struct token),
+                      id->u.macro->body[j]);
+            *AT(&img, uintptr_t, slot) = tok;
+            slot += sizeof(uintptr_t);
+        }
+        AT(&img, struct pch_macro, h.macros)[i].name = name;
+        AT(&img, struct pch_macro, h.macros)[i].m = m;
+    }
+    for (size_t i = 0; i < vec_len(stream); i++, tok++)
+        put_token(&img, h.tokens + tok * sizeof(struct token),
+                  vec_at(stream, i));
+
+    memcpy(h.magic, PCH_MAGIC, sizeof(h.magic));
+    h.key = put_string(&img, pch_key);
+    h.source = put_string(&img, pfile->file);
+    h.size = img.len;
+    memcpy(img.buf, &h, sizeof(h));
+
+    if (fwrite(img.buf, img.len, 1, fp) != 1) {
+        fprintf(stderr, "can't write the precompiled header\n");
+        pfile->errors++;
+    }
+
+    for (int i = 0; i < NSTRINGS; i++) {
+        struct sentry *p = img.strings[i];
+        while (p) {
+            struct sentry *link = p->link;
+            free(p);
+            p = link;
+        }
+    }
+    free(img.buf);
+    vec_free(stream);
+    vec_free(macros);
+    vec_free(files);
+}
+
+/// load
+
+// a string of the image, NULL if out of range
+static const char *string_at(const char *base, size_t size, uint32_t off)
+{
+    if (off == 0 || off >= size || memchr(base + off, 0, size - off) == NULL)
+        return NULL;
+    return base + off;
+}
+
+static bool in_image(const struct pch_header *h, uint32_t off, size_t n, size_t size)
+{
+    return off <= h->size && n <= (h->size - off) / size;
+}
+
+static bool check_image(const char *base, size_t size)
+{
+    const struct pch_header *h = (const struct pch_header *)base;
+    const char *key;
+
+    if (size < sizeof(*h) || memcmp(h->magic, PCH_MAGIC, sizeof(h->magic)) ||
+        h->size != size) {
+        stats.status = "invalid";
+        return false;
+    }
+    if (!in_image(h, h->files, h->nfiles, sizeof(struct pch_file)) ||
+        !in_image(h, h->headers, h->nheaders, sizeof(struct pch_hdr)) ||
+        !in_image(h, h->macros, h->nmacros, sizeof(struct pch_macro)) ||
+        !in_image(h, h->tokens, h->ntokens, sizeof(struct token)) ||
+        !in_image(h, h->slots, h->stream, sizeof(uintptr_t)) ||
+        !in_image(h, h->lines, h->nlines, sizeof(struct pch_line)) ||
+        h->stream > h->ntokens) {
+        stats.status = "invalid";
+        return false;
+    }
+    key = string_at(base, size, h->key);
+    if (key == NULL || strcmp(key, pch_key)) {
+        stats.status = "options differ";
+        return false;
+    }
+
+    const struct pch_file *files = (const struct pch_file *)(base + h->files);
+    for (uint32_t i = 0; i < h->nfiles; i++) {
+        const char *path = string_at(base, size, files[i].path);
+        struct stat st;
+        if (path == NULL || stat(path, &st) < 0 ||
+            ST_MTIM(&st).tv_sec != files[i].mtime ||
+            ST_MTIM(&st).tv_nsec != files[i].mtime_nsec ||
+            st.st_size != files[i].size) {
+            stats.status = "out of date";
+            return false;
+        }
+    }
+    return true;
+}
+
+static struct ident *ident_at(struct file *pfile, const char *base, uintptr_t off)
+{
+    const char *name = base + off;
+    return idtab_lookup(pfile->idtab, name, strlen(name), ID_CREATE);
+}
+
+/**
+ * The lines of the image follow the ones of the unit
+ * from 'first' on, the token locations are moved there.
+ */
+static void relocate_token(struct file *pfile, char *base, size_t size,
+                           struct token *t, unsigned long long first,
+                           unsigned int nlines)
+{
+    unsigned int line = t->loc >> LOC_COLUMN_BITS;
+
+    if (line == 0 || line > nlines)
+        t->loc = 0;
+    else
+        t->loc = (first + ((unsigned long long)(line - 1) << LOC_COLUMN_BITS)) |
+            (t->loc & LOC_MAX_COLUMN);
+    if (t->id == ID) {
+        t->u.ident = ident_at(pfile, base, (uintptr_t)t->u.ident);
+    } else if (t->u.lit) {
+        uintptr_t off = (uintptr_t)t->u.lit;
+        if (off > size - sizeof(struct literal)) {
+            t->u.lit = NULL;
+            return;
+        }
+        t->u.lit = (struct literal *)(base + off);
+        if (t->u.lit->str)
+            t->u.lit->str = strs(base + (uintptr_t)t->u.lit->str);
+    }
+}
+
+/**
+ * Load the image at 'path' into 'pfile'. Returns false if
+ * it can't be used, '*source' is then the header to read
+ * instead (NULL if unknown).
+ */
+bool pch_load(struct file *pfile, const char *path, const char **source)
+{
+    struct pch_header *h;
+    struct token *tokens;
+    struct stat st;
+    unsigned long long first;
+    char *base;
+    int fd;
+
+    *source = NULL;
+    stats.status = "unreadable";
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return false;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return false;
+
+    h = (struct pch_header *)base;
+    if (!check_image(base, st.st_size)) {
+        const char *s = st.st_size >= sizeof(*h) && h->size == st.st_size ?
+            string_at(base, st.st_size, h->source) : NULL;
+        if (s)
+            *source = strdup(s);
+        munmap(base, st.st_size);
+        return false;
+    }
+    map_base = base;
+    map_len = st.st_size;
+    stats.status = "loaded";
+
+    // the slots are token indexes
+    tokens = (struct token *)(base + h->tokens);
+    for (uint32_t i = 0; i < h->stream; i++) {
+        uintptr_t *slot = (uintptr_t *)(base + h->slots) + i;
+        *slot = (uintptr_t)&tokens[*slot < h->ntokens ? *slot : 0];
+    }
+    struct pch_line *lines = (struct pch_line *)(base + h->lines);
+    first = loc_reserve(h->nlines);
+    for (uint32_t i = 0; i < h->nlines; i++)
+        loc_set_line(first + ((unsigned long long)i << LOC_COLUMN_BITS),
+                     string_at(base, st.st_size, lines[i].file), lines[i].line);
+    for (uint32_t i = 0; i < h->ntokens; i++)
+        relocate_token(pfile, base, st.st_size, &tokens[i], first, h->nlines);
+
+    struct pch_macro *macros = (struct pch_macro *)(base + h->macros);
+    for (uint32_t i = 0; i < h->nmacros; i++) {
+        struct macro *m = &macros[i].m;
+        struct ident *id = ident_at(pfile, base, macros[i].name);
+        m->src.file = m->src.file ? base + (uintptr_t)m->src.file : NULL;
+        m->params = (struct token **)(base + (uintptr_t)m->params);
+        m->body = (struct token **)(base + (uintptr_t)m->body);
+        m->handler = NULL;
+        id->type = CT_MACRO;
+        id->u.macro = m;
+    }
+
+    struct pch_hdr *headers = (struct pch_hdr *)(base + h->headers);
+    for (uint32_t i = 0; i < h->nheaders; i++) {
+        struct header *p = lookup_header(pfile, base + headers[i].path);
+        if (headers[i].guard)
+            p->guard = ident_at(pfile, base, headers[i].guard);
+        p->once = headers[i].once;
+    }
+
+    struct pch_file *files = (struct pch_file *)(base + h->files);
+    for (uint32_t i = 0; i < h->nfiles; i++)
+        deps_add(base + files[i].path, files[i].sys);
+
+    pfile->pch_tokens = tokens + h->stream;
+    pfile->pch_end = tokens + h->ntokens;
+    stats.nmacros = h->nmacros;
+    stats.ntokens = h->ntokens - h->stream;
+    return true;
+}
+
+void pch_dump(void)
+{
+    if (stats.status)
+        dlog("pch: %s, %u macros, %u tokens.",
+             stats.status, stats.nmacros, stats.ntokens);
+}
@@ -0,0 +1,300 @@
+#include "compat.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include "internal.h"
+#include "libutils.h"
+
+/**
+ * Read-ahead of headers (-freadahead).
+ *
+ * A helper thread reads the input and scans it for
+ * #include lines with a literal name, resolves them the
+ * way search_header() does and reads the headers found,
+ * which are scanned in turn. The preprocessor then finds
+ * the directories and the contents in the kernel caches
+ * instead of waiting for the disk.
+ *
+ * Nothing the thread finds is used: a name that resolves
+ * otherwise (an include of a macro, or one in a skipped
+ * group) is looked up by the preprocessor as before. So
+ * the thread has its own tables and only calls the C
+ * library, and a full queue just drops the header.
+ */
+
+#define QUEUE_DEPTH  64
+#define NSEEN        1024
+
+struct seen {
+    char *key;
+    struct seen *link;
+};
+
+// set up at run time, 9cc can't compile their initializers
+static pthread_mutex_t lock;
+static pthread_cond_t work, idle;
+static bool started;
+static bool busy;               // a file is being read
+static char *queue[QUEUE_DEPTH];
+static unsigned int qhead, qlen;
+
+// owned by the thread while busy
+static char **std_dirs, **usr_dirs;
+static struct seen *seen[NSEEN];
+static struct {
+    unsigned int files;
+    unsigned long bytes;
+    unsigned int dropped;
+} stats;
+
+// false if 'key' was seen before
+static bool first_time(const char *key)
+{
+    unsigned int h = strhash(key) & (NSEEN - 1);
+    struct seen *p;
+
+    for (p = seen[h]; p; p = p->link)
+        if (!strcmp(p->key, key))
+            return false;
+    if ((p = malloc(sizeof(struct seen))) == NULL)
+        return false;
+    if ((p->key = strdup(key)) == NULL) {
+        free(p);
+        return false;
+    }
+    p->link = seen[h];
+    seen[h] = p;
+    return true;
+}
+
+static void push(const char *path)
+{
+    char *s;
+
+    if (!first_time(path))
+        return;
+    pthread_mutex_lock(&lock);
+    if (qlen < QUEUE_DEPTH && (s = strdup(path))) {
+        queue[(qhead + qlen++) % QUEUE_DEPTH] = s;
+        pthread_cond_signal(&work);
+    } else {
+        stats.dropped++;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+// returns the contents of a regular file, NULL on error
+static char *read_file(const char *path, size_t *len)
+{
+    struct stat st;
+    ssize_t count;
+    size_t total = 0;
+    char *buf;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY | O_NOCTTY)) < 0)
+        return NULL;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+        (buf = malloc(st.st_size + 1)) == NULL) {
+        close(fd);
+        return NULL;
+    }
+    while (total < st.st_size &&
+           (count = read(fd, buf + total, st.st_size - total)) > 0)
+        total += count;
+    close(fd);
+    buf[total] = '\0';
+    *len = total;
+    return buf;
+}
+
+static bool probe(char *file, const char *dir, const char *name)
+{
+    struct stat st;
+
+    snprintf(file, PATH_MAX, "%s/%s", dir, name);
+    return stat(file, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+// like search(): the std or usr paths, then the including directory
+static void resolve(const char *name, bool std, const char *dir)
+{
+    char key[PATH_MAX * 2];
+    char file[PATH_MAX];
+    char **dirs = std ? std_dirs : usr_dirs;
+
+    if (name[0] == '/') {
+        push(name);
+        return;
+    }
+    snprintf(key, sizeof(key), "%c%s\n%s", std ? '<' : '"', std ? "" : dir, name);
+    if (!first_time(key))
+        return;
+    for (; *dirs; dirs++)
+        if (probe(file, *dirs, name)) {
+            push(file);
+            return;
+        }
+    if (!std && probe(file, dir, name))
+        push(file);
+}
+
+// the #include lines of 'buf', comments and splices aside
+static void scan(const char *buf, const char *dir)
+{
+    const char *p = buf;
+
+    for (; p; p = strchr(p, '\n'), p = p ? p + 1 : NULL) {
+        const char *name;
+        int sep;
+
+        while (*p == ' ' || *p == '\t')
+            p++;
+        // stays on the '\n' or NUL of an empty line
+        if (*p != '#')
+            continue;
+        p++;
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (strncmp(p, "include", 7))
+            continue;
+        p += 7;
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p == '"')
+            sep = '"';
+        else if (*p == '<')
+            sep = '>';
+        else
+            continue;
+        name = ++p;
+        while (*p && *p != sep && *p != '\n')
+            p++;
+        if (*p == sep && p > name) {
+            char *s = strndup(name, p - name);
+            if (s)
+                resolve(s, sep == '>', dir);
+            free(s);
+        }
+    }
+}
+
+static void read_ahead(const char *path)
+{
+    size_t len;
+    char *buf = read_file(path, &len);
+    char *tmp;
+
+    if (buf == NULL)
+        return;
+    pthread_mutex_lock(&lock);
+    stats.files++;
+    stats.bytes += len;
+    pthread_mutex_unlock(&lock);
+    if ((tmp = strdup(path))) {
+        scan(buf, dirname(tmp));
+        free(tmp);
+    }
+    free(buf);
+}
+
+static void *helper(void *arg)
+{
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        char *path;
+
+        while (qlen == 0)
+            pthread_cond_wait(&work, &lock);
+        path = queue[qhead];
+        qhead = (qhead + 1) % QUEUE_DEPTH;
+        qlen--;
+        busy = true;
+        pthread_mutex_unlock(&lock);
+
+        read_ahead(path);
+        free(path);
+
+        pthread_mutex_lock(&lock);
+        busy = false;
+        pthread_cond_broadcast(&idle);
+    }
+    return NULL;
+}
+
+static char **copy_dirs(struct vector *v)
+{
+    char **dirs = xcalloc(vec_len(v) + 1, sizeof(char *));
+    for (size_t i = 0; i < vec_len(v); i++)
+        dirs[i] = strdup(vec_at(v, i));
+    return dirs;
+}
+
+static void free_dirs(char **dirs)
+{
+    for (char **p = dirs; p && *p; p++)
+        free(*p);
+    free(dirs);
+}
+
+/**
+ * Starts reading ahead the headers of 'file', once the
+ * include paths are set. Whatever was left of the last
+ * unit is dropped.
+ */
+void readahead_begin(struct file *pfile, const char *file)
+{
+    pthread_t thread;
+
+    if (!started) {
+        pthread_mutex_init(&lock, NULL);
+        pthread_cond_init(&work, NULL);
+        pthread_cond_init(&idle, NULL);
+        if (pthread_create(&thread, NULL, helper, NULL))
+            return;
+        pthread_detach(thread);
+        started = true;
+    }
+
+    pthread_mutex_lock(&lock);
+    while (qlen) {
+        free(queue[qhead]);
+        qhead = (qhead + 1) % QUEUE_DEPTH;
+        qlen--;
+    }
+    while (busy)
+        pthread_cond_wait(&idle, &lock);
+
+    for (int i = 0; i < NSEEN; i++) {
+        struct seen *p = seen[i];
+        while (p) {
+            struct seen *link = p->link;
+            free(p->key);
+            free(p);
+            p = link;
+        }
+        seen[i] = NULL;
+    }
+    memset(&stats, 0, sizeof(stats));
+    free_dirs(std_dirs);
+    free_dirs(usr_dirs);
+    std_dirs = copy_dirs(pfile->std_include_paths);
+    usr_dirs = copy_dirs(pfile->usr_include_paths);
+    pthread_mutex_unlock(&lock);
+
+    // stdin can't be read twice
+    if (file[0])
+        push(file);
+}
+
+void readahead_dump(void)
+{
+    if (!started)
+        return;
+    pthread_mutex_lock(&lock);
+    dlog("readahead: %u files, %lu bytes, %u dropped.",
+         stats.files, stats.bytes, stats.dropped);
+    pthread_mutex_unlock(&lock);
+}
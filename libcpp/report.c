@@ -0,0 +1,485 @@
+#include "compat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include "internal.h"
+#include "libutils.h"
+
+/**
+ * Preprocessor report (-fcpp-report[=json=FILE]).
+ *
+ * The cost of each file of the unit: how often it was
+ * included or skipped by its guard, what was read and
+ * lexed in it, and the wall time between entering and
+ * leaving it. The time is inclusive of the headers it
+ * includes, and of whatever consumes its tokens (the
+ * parser with -S); the exclusive time leaves the headers
+ * out. The counts are exclusive.
+ *
+ * Files are entered and left by buffer_sentinel() and
+ * buffer_unsentinel(), and include_file() reports the
+ * skipped ones. The counters are always kept: a frame
+ * takes their difference.
+ *
+ * The macro report (-fmacro-report=N) has the N macros
+ * that produced the most tokens and took the most time.
+ * An expansion is timed in expand(): collecting the
+ * arguments, expanding them before substitution, and the
+ * rest of subst(). Rescanning happens later, as the
+ * replacement is read again, so the time of the macros
+ * found there is also charged to the macros in the
+ * hideset of their name: those that produced it.
+ */
+
+#define NFILES   256
+#define NMACROS  1024
+
+struct rfile {
+    const char *path;
+    unsigned int included;      // entered or skipped
+    unsigned int skipped;       // by a guard or #pragma once
+    unsigned long bytes;
+    unsigned long lines;
+    struct cpp_counts counts;
+    double incl, excl;          // seconds
+    struct rfile *link;
+};
+
+// a node of the include tree, in preorder
+struct node {
+    struct rfile *file;
+    unsigned int depth;
+    bool skipped;
+    double time;
+};
+
+struct frame {
+    struct rfile *file;
+    size_t node;
+    struct timespec start;
+    struct cpp_counts start_counts;
+    struct cpp_counts child_counts;
+    double child_time;
+};
+
+struct cpp_counts cpp_counts;
+unsigned int macro_report;      // -fmacro-report=N
+unsigned int expand_depth;      // of argument pre-expansion
+
+static int mode;                // 't'ext, 'j'son or 0 if off
+static const char *json_file;   // not stderr, diagnostics go there
+static struct rfile *files[NFILES];
+static unsigned int nfiles;
+static struct node *nodes;
+static size_t nnodes, alloc_nodes;
+static struct frame *frames;
+static unsigned int nframes, alloc_frames;
+static struct mstat *mstats[NMACROS];
+static unsigned int nmstats;
+
+// called before the options of a unit are parsed
+void report_begin(void)
+{
+    for (int i = 0; i < NMACROS; i++) {
+        struct mstat *p = mstats[i];
+        while (p) {
+            struct mstat *link = p->link;
+            free(p);
+            p = link;
+        }
+        mstats[i] = NULL;
+    }
+    nmstats = 0;
+    macro_report = 0;
+    expand_depth = 0;
+    for (int i = 0; i < NFILES; i++) {
+        struct rfile *p = files[i];
+        while (p) {
+            struct rfile *link = p->link;
+            free(p);
+            p = link;
+        }
+        files[i] = NULL;
+    }
+    nfiles = 0;
+    nnodes = nframes = 0;
+    mode = 0;
+}
+
+bool report_option(const char *arg)
+{
+    if (!strcmp(arg, "-fcpp-report")) {
+        mode = 't';
+    } else if (!strncmp(arg, "-fcpp-report=json", 17)) {
+        if (arg[17] != '=' || arg[18] == '\0')
+            die("missing file name after '-fcpp-report=json='");
+        mode = 'j';
+        json_file = arg + 18;
+    } else if (!strncmp(arg, "-fmacro-report=", 15)) {
+        int n = atoi(arg + 15);
+        if (n <= 0)
+            die("invalid number of macros: %s", arg + 15);
+        macro_report = n;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+double report_clock(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static double since(struct timespec start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static void add_counts(struct cpp_counts *a, struct cpp_counts b)
+{
+    a->tokens += b.tokens;
+    a->directives += b.directives;
+    a->expansions += b.expansions;
+}
+
+static struct cpp_counts sub_counts(struct cpp_counts a, struct cpp_counts b)
+{
+    a.tokens -= b.tokens;
+    a.directives -= b.directives;
+    a.expansions -= b.expansions;
+    return a;
+}
+
+static struct rfile *lookup_file(const char *path)
+{
+    unsigned int h = strhash(path) & (NFILES - 1);
+    struct rfile *p;
+
+    for (p = files[h]; p; p = p->link)
+        if (!strcmp(p->path, path))
+            return p;
+
+    p = zmalloc(sizeof(struct rfile));
+    p->path = path;
+    p->link = files[h];
+    files[h] = p;
+    nfiles++;
+    return p;
+}
+
+static size_t add_node(struct rfile *file, bool skipped)
+{
+    if (nnodes == alloc_nodes) {
+        alloc_nodes = alloc_nodes ? alloc_nodes * 2 : 256;
+        nodes = xrealloc(nodes, alloc_nodes * sizeof(struct node));
+    }
+    nodes[nnodes] = (struct node){ file, nframes, skipped, 0 };
+    return nnodes++;
+}
+
+// a file buffer is pushed
+void report_enter(struct buffer *pb)
+{
+    struct rfile *file;
+    struct frame *f;
+
+    if (!mode)
+        return;
+    file = lookup_file(pb->name);
+    file->included++;
+    file->bytes += pb->limit - pb->buf;
+
+    if (nframes == alloc_frames) {
+        alloc_frames = alloc_frames ? alloc_frames * 2 : 32;
+        frames = xrealloc(frames, alloc_frames * sizeof(struct frame));
+    }
+    f = &frames[nframes];
+    f->node = add_node(file, false);
+    nframes++;
+    f->file = file;
+    f->start_counts = cpp_counts;
+    f->child_counts = (struct cpp_counts){ 0, 0, 0 };
+    f->child_time = 0;
+    clock_gettime(CLOCK_MONOTONIC, &f->start);
+}
+
+// a file buffer is popped
+void report_leave(struct buffer *pb)
+{
+    struct frame *f;
+    struct cpp_counts incl;
+    double time;
+
+    if (!mode || nframes == 0)
+        return;
+    f = &frames[--nframes];
+    time = since(f->start);
+    incl = sub_counts(cpp_counts, f->start_counts);
+
+    // the last line may have no newline
+    f->file->lines += pb->line - 1 +
+        (pb->limit > pb->buf && pb->limit[-1] != '\n');
+    add_counts(&f->file->counts, sub_counts(incl, f->child_counts));
+    f->file->incl += time;
+    f->file->excl += time - f->child_time;
+    nodes[f->node].time = time;
+    if (nframes) {
+        add_counts(&frames[nframes - 1].child_counts, incl);
+        frames[nframes - 1].child_time += time;
+    }
+}
+
+// 'path' was not entered, its guard is defined
+void report_skip(const char *path)
+{
+    struct rfile *file;
+
+    if (!mode)
+        return;
+    file = lookup_file(path);
+    file->included++;
+    file->skipped++;
+    add_node(file, true);
+}
+
+static int cmp_excl(const void *a, const void *b)
+{
+    const struct rfile *x = *(const struct rfile **)a;
+    const struct rfile *y = *(const struct rfile **)b;
+    if (x->excl != y->excl)
+        return x->excl < y->excl ? 1 : -1;
+    return strcmp(x->path, y->path);
+}
+
+// by exclusive time, the most expensive first
+static struct rfile **sorted_files(void)
+{
+    struct rfile **v = xmalloc((nfiles + 1) * sizeof(struct rfile *));
+    unsigned int n = 0;
+
+    for (int i = 0; i < NFILES; i++)
+        for (struct rfile *p = files[i]; p; p = p->link)
+            v[n++] = p;
+    qsort(v, n, sizeof(struct rfile *), cmp_excl);
+    return v;
+}
+
+static void print_text(FILE *fp)
+{
+    struct rfile **v = sorted_files();
+
+    fprintf(fp, "%10s %10s %8s %7s %10s %8s %9s %10s %10s  %s\n",
+            "incl(ms)", "excl(ms)", "included", "skipped", "bytes",
+            "lines", "tokens", "directives", "expansions", "file");
+    for (unsigned int i = 0; i < nfiles; i++) {
+        struct rfile *p = v[i];
+        fprintf(fp, "%10.3f %10.3f %8u %7u %10lu %8lu %9lu %10lu %10lu  %s\n",
+                p->incl * 1e3, p->excl * 1e3, p->included, p->skipped,
+                p->bytes, p->lines, p->counts.tokens,
+                p->counts.directives, p->counts.expansions, p->path);
+    }
+    free(v);
+
+    fprintf(fp, "\ninclude tree:\n");
+    for (size_t i = 0; i < nnodes; i++) {
+        struct node *n = &nodes[i];
+        fprintf(fp, "%*s%s", (int)(n->depth + 1) * 2, "", n->file->path);
+        if (n->skipped)
+            fprintf(fp, " (skipped)\n");
+        else
+            fprintf(fp, " %.3fms\n", n->time * 1e3);
+    }
+}
+
+static void print_string(FILE *fp, const char *s)
+{
+    fputc('"', fp);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(fp, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(fp, "\\u%04x", *s);
+        else
+            fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+static void print_json(FILE *fp)
+{
+    struct rfile **v = sorted_files();
+    unsigned int depth = 0;
+
+    fprintf(fp, "{\"files\": [");
+    for (unsigned int i = 0; i < nfiles; i++) {
+        struct rfile *p = v[i];
+        fprintf(fp, "%s\n  {\"path\": ", i ? "," : "");
+        print_string(fp, p->path);
+        fprintf(fp, ", \"included\": %u, \"skipped\": %u, \"bytes\": %lu, "
+                "\"lines\": %lu, \"tokens\": %lu, \"directives\": %lu, "
+                "\"expansions\": %lu, \"inclusive\": %.6f, "
+                "\"exclusive\": %.6f}",
+                p->included, p->skipped, p->bytes, p->lines,
+                p->counts.tokens, p->counts.directives,
+                p->counts.expansions, p->incl, p->excl);
+    }
+    free(v);
+
+    // the preorder nodes nest by depth
+    fprintf(fp, "],\n \"tree\": [");
+    for (size_t i = 0; i < nnodes; i++) {
+        struct node *n = &nodes[i];
+        for (; depth > n->depth; depth--)
+            fprintf(fp, "]}");
+        fprintf(fp, "%s{\"path\": ", i && nodes[i - 1].depth >= n->depth ? ", " : "");
+        print_string(fp, n->file->path);
+        if (n->skipped) {
+            fprintf(fp, ", \"skipped\": true}");
+        } else {
+            fprintf(fp, ", \"time\": %.6f, \"includes\": [", n->time);
+            depth++;
+        }
+    }
+    for (; depth > 0; depth--)
+        fprintf(fp, "]}");
+    fprintf(fp, "]}\n");
+}
+
+static struct mstat *lookup_mstat(const char *name)
+{
+    unsigned int h = ((uintptr_t)name >> 3) & (NMACROS - 1);
+    struct mstat *p;
+
+    for (p = mstats[h]; p; p = p->link)
+        if (p->name == name)
+            return p;
+    return NULL;
+}
+
+/**
+ * An expansion of macro 'name' (an interned string) by a
+ * token of 'hideset' starts.
+ */
+void macro_enter(struct mcall *c, const char *name, struct macro *m,
+                 struct hideset *hideset)
+{
+    struct mstat *p = lookup_mstat(name);
+    unsigned int depth = expand_depth + (hideset ? hideset->len : 0) + 1;
+
+    if (p == NULL) {
+        unsigned int h = ((uintptr_t)name >> 3) & (NMACROS - 1);
+        p = zmalloc(sizeof(struct mstat));
+        p->name = name;
+        p->link = mstats[h];
+        mstats[h] = p;
+        nmstats++;
+    }
+    // the last definition
+    p->src = m->src;
+    p->calls++;
+    p->depth = MAX(p->depth, depth);
+
+    c->stat = p;
+    c->hideset = hideset;
+    c->ops = hideset_ops();
+    c->args = c->pre = 0;
+    c->start = report_clock();
+}
+
+// the replacement of 'c' is pushed back
+void macro_leave(struct mcall *c)
+{
+    struct mstat *p = c->stat;
+    double self = report_clock() - c->start - c->pre;
+
+    p->args += c->args;
+    p->pre += c->pre;
+    p->subst += self - c->args;
+    p->hidesets += hideset_ops() - c->ops;
+    // the rescan of the macros that produced the name
+    for (unsigned int i = 0; c->hideset && i < c->hideset->len; i++) {
+        struct mstat *q = lookup_mstat(c->hideset->names[i]);
+        if (q)
+            q->rescan += self;
+    }
+}
+
+static double total_time(const struct mstat *p)
+{
+    return p->args + p->pre + p->subst + p->rescan;
+}
+
+static int cmp_tokens(const void *a, const void *b)
+{
+    const struct mstat *x = *(const struct mstat **)a;
+    const struct mstat *y = *(const struct mstat **)b;
+    if (x->tokens != y->tokens)
+        return x->tokens < y->tokens ? 1 : -1;
+    return strcmp(x->name, y->name);
+}
+
+static int cmp_time(const void *a, const void *b)
+{
+    const struct mstat *x = *(const struct mstat **)a;
+    const struct mstat *y = *(const struct mstat **)b;
+    if (total_time(x) != total_time(y))
+        return total_time(x) < total_time(y) ? 1 : -1;
+    return strcmp(x->name, y->name);
+}
+
+static void print_macros(FILE *fp, struct mstat **v, const char *title)
+{
+    unsigned int n = MIN(nmstats, macro_report);
+
+    fprintf(fp, "macros by %s:\n", title);
+    fprintf(fp, "%8s %10s %5s %9s %9s %9s %9s %9s  %s\n",
+            "calls", "tokens", "depth", "args(ms)", "pre(ms)", "subst(ms)",
+            "rescan(ms)", "hidesets", "macro");
+    for (unsigned int i = 0; i < n; i++) {
+        struct mstat *p = v[i];
+        fprintf(fp, "%8lu %10lu %5u %9.3f %9.3f %9.3f %9.3f %9lu  %s  %s:%u\n",
+                p->calls, p->tokens, p->depth, p->args * 1e3, p->pre * 1e3,
+                p->subst * 1e3, p->rescan * 1e3, p->hidesets, p->name,
+                p->src.file ? p->src.file : "<built-in>", p->src.line);
+    }
+}
+
+static void print_macro_report(FILE *fp)
+{
+    struct mstat **v = xmalloc((nmstats + 1) * sizeof(struct mstat *));
+    unsigned int n = 0;
+
+    for (int i = 0; i < NMACROS; i++)
+        for (struct mstat *p = mstats[i]; p; p = p->link)
+            v[n++] = p;
+    qsort(v, n, sizeof(struct mstat *), cmp_tokens);
+    print_macros(fp, v, "tokens produced");
+    fprintf(fp, "\n");
+    qsort(v, n, sizeof(struct mstat *), cmp_time);
+    print_macros(fp, v, "time");
+    free(v);
+}
+
+/// write the reports of the current unit.
+void cpp_write_report(void)
+{
+    if (mode == 't') {
+        print_text(stderr);
+    } else if (mode == 'j') {
+        FILE *fp = fopen(json_file, "w");
+        if (fp == NULL)
+            die("can't write %s: %s", json_file, strerror(errno));
+        print_json(fp);
+        if (fclose(fp) != 0)
+            die("can't write %s: %s", json_file, strerror(errno));
+    }
+    if (macro_report)
+        print_macro_report(stderr);
+}
@@ -0,0 +1,291 @@
+#include <stdint.h>
+#include "internal.h"
+#include "libutils.h"
+
+/**
+ * Scanning kernels of the lexer hot loops.
+ *
+ * Every scan stops at a '\n' at the latest, which the
+ * lexer keeps at the end of each clean line and after
+ * the buffer. The vector kernels read whole aligned
+ * blocks, which never cross a page, so reading past
+ * that '\n' is safe.
+ *
+ * On x86-64 the AVX2 kernels are used if the cpu has
+ * them, SSE2 otherwise. Other targets get the scalar
+ * loops, and so do builds with AddressSanitizer or
+ * MemorySanitizer, which rightly see those reads as
+ * out of the bounds of the buffer.
+ */
+
+#if defined(__SANITIZE_ADDRESS__)
+#define NO_SIMD
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(memory_sanitizer)
+#define NO_SIMD
+#endif
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(NO_SIMD)
+#define HAVE_SIMD
+#include <immintrin.h>
+#endif
+
+typedef const unsigned char *(*kernel_t)(const unsigned char *);
+
+enum { SCAN_LINE, SCAN_NEWLINE, SCAN_COMMENT, SCAN_IDENT, SCAN_SKIP, NKERNELS };
+
+struct scanner {
+    const char *name;
+    kernel_t kernels[NKERNELS];
+};
+
+static const char *kernel_names[NKERNELS] = {
+    "line", "line comment", "block comment", "identifier", "skipped group"
+};
+
+static const struct scanner *scanner;
+static unsigned long long scanned[NKERNELS];
+static unsigned long long calls[NKERNELS];
+
+/// scalar
+
+static const unsigned char *scalar_line(const unsigned char *s)
+{
+    while (*s != '\n' && *s != '\\' && *s != '\r')
+        s++;
+    return s;
+}
+
+static const unsigned char *scalar_newline(const unsigned char *s)
+{
+    while (*s != '\n')
+        s++;
+    return s;
+}
+
+static const unsigned char *scalar_comment(const unsigned char *s)
+{
+    while (*s != '/' && *s != '\n')
+        s++;
+    return s;
+}
+
+static inline bool is_ident_char(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+        (c >= '0' && c <= '9') || c == '_';
+}
+
+static const unsigned char *scalar_ident(const unsigned char *s)
+{
+    while (is_ident_char(*s))
+        s++;
+    return s;
+}
+
+static const unsigned char *scalar_skip(const unsigned char *s)
+{
+    while (*s != '\n' && *s != '/' && *s != '"' && *s != '\'')
+        s++;
+    return s;
+}
+
+static const struct scanner scalar_scanner = {
+    "scalar",
+    { scalar_line, scalar_newline, scalar_comment, scalar_ident, scalar_skip }
+};
+
+#ifdef HAVE_SIMD
+
+/// SSE2
+
+// 'c' in [lo, hi], as signed bytes (lo and hi are ascii)
+#define SSE2_RANGE(x, lo, hi)                                   \
+    _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8((lo) - 1)),   \
+                  _mm_cmplt_epi8(x, _mm_set1_epi8((hi) + 1)))
+
+/**
+ * 'MATCH' sets the bytes to stop at. The first block is
+ * loaded from the aligned address below 's', and the
+ * bytes before 's' are shifted out of the mask.
+ */
+#define SSE2_KERNEL(name, MATCH)                                        \
+    static const unsigned char *name(const unsigned char *s)            \
+    {                                                                   \
+        unsigned int off = (uintptr_t)s & 15;                           \
+        const __m128i *p = (const __m128i *)(s - off);                  \
+        __m128i x = _mm_load_si128(p);                                  \
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(MATCH) >> off; \
+        if (mask)                                                       \
+            return s + __builtin_ctz(mask);                             \
+        for (;;) {                                                      \
+            x = _mm_load_si128(++p);                                    \
+            mask = _mm_movemask_epi8(MATCH);                            \
+            if (mask)                                                   \
+                return (const unsigned char *)p + __builtin_ctz(mask);  \
+        }                                                               \
+    }
+
+SSE2_KERNEL(sse2_line,
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\n')),
+                                      _mm_cmpeq_epi8(x, _mm_set1_epi8('\\'))),
+                         _mm_cmpeq_epi8(x, _mm_set1_epi8('\r'))))
+
+SSE2_KERNEL(sse2_newline,
+            _mm_cmpeq_epi8(x, _mm_set1_epi8('\n')))
+
+SSE2_KERNEL(sse2_comment,
+            _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('/')),
+                         _mm_cmpeq_epi8(x, _mm_set1_epi8('\n'))))
+
+// bytes >= 0x80 are negative, so never in a range
+SSE2_KERNEL(sse2_ident,
+            _mm_xor_si128(_mm_or_si128(_mm_or_si128(SSE2_RANGE(x, 'a', 'z'),
+                                                    SSE2_RANGE(x, 'A', 'Z')),
+                                       _mm_or_si128(SSE2_RANGE(x, '0', '9'),
+                                                    _mm_cmpeq_epi8(x, _mm_set1_epi8('_')))),
+                          _mm_set1_epi8(-1)))
+
+SSE2_KERNEL(sse2_skip,
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\n')),
+                                      _mm_cmpeq_epi8(x, _mm_set1_epi8('/'))),
+                         _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('"')),
+                                      _mm_cmpeq_epi8(x, _mm_set1_epi8('\'')))))
+
+static const struct scanner sse2_scanner = {
+    "sse2",
+    { sse2_line, sse2_newline, sse2_comment, sse2_ident, sse2_skip }
+};
+
+/// AVX2
+
+#define AVX2_RANGE(x, lo, hi)                                           \
+    _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8((lo) - 1)),  \
+                     _mm256_cmpgt_epi8(_mm256_set1_epi8((hi) + 1), x))
+
+#define AVX2_KERNEL(name, MATCH)                                        \
+    __attribute__((target("avx2")))                                    \
+    static const unsigned char *name(const unsigned char *s)            \
+    {                                                                   \
+        unsigned int off = (uintptr_t)s & 31;                           \
+        const __m256i *p = (const __m256i *)(s - off);                  \
+        __m256i x = _mm256_load_si256(p);                               \
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(MATCH) >> off; \
+        if (mask)                                                       \
+            return s + __builtin_ctz(mask);                             \
+        for (;;) {                                                      \
+            x = _mm256_load_si256(++p);                                 \
+            mask = _mm256_movemask_epi8(MATCH);                         \
+            if (mask)                                                   \
+                return (const unsigned char *)p + __builtin_ctz(mask);  \
+        }                                                               \
+    }
+
+AVX2_KERNEL(avx2_line,
+            _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')),
+                                            _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\\'))),
+                            _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\r'))))
+
+AVX2_KERNEL(avx2_newline,
+            _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')))
+
+AVX2_KERNEL(avx2_comment,
+            _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('/')),
+                            _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n'))))
+
+AVX2_KERNEL(avx2_ident,
+            _mm256_xor_si256(_mm256_or_si256(_mm256_or_si256(AVX2_RANGE(x, 'a', 'z'),
+                                                             AVX2_RANGE(x, 'A', 'Z')),
+                                             _mm256_or_si256(AVX2_RANGE(x, '0', '9'),
+                                                             _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_')))),
+                             _mm256_set1_epi8(-1)))
+
+AVX2_KERNEL(avx2_skip,
+            _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')),
+                                            _mm256_cmpeq_epi8(x, _mm256_set1_epi8('/'))),
+                            _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('"')),
+                                            _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\'')))))
+
+static const struct scanner avx2_scanner = {
+    "avx2",
+    { avx2_line, avx2_newline, avx2_comment, avx2_ident, avx2_skip }
+};
+
+#endif  /* HAVE_SIMD */
+
+static void scan_init(void)
+{
+#ifdef HAVE_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        scanner = &avx2_scanner;
+    else if (__builtin_cpu_supports("sse2"))
+        scanner = &sse2_scanner;
+    else
+        scanner = &scalar_scanner;
+#else
+    scanner = &scalar_scanner;
+#endif
+}
+
+static inline const unsigned char *scan(int k, const unsigned char *s)
+{
+    const unsigned char *p;
+
+    if (scanner == NULL)
+        scan_init();
+    p = scanner->kernels[k](s);
+    scanned[k] += p - s;
+    calls[k]++;
+    return p;
+}
+
+// the first '\n', '\\' or '\r'
+const unsigned char *scan_line(const unsigned char *s)
+{
+    return scan(SCAN_LINE, s);
+}
+
+// the first '\n'
+const unsigned char *scan_newline(const unsigned char *s)
+{
+    return scan(SCAN_NEWLINE, s);
+}
+
+// the first '/' or '\n'
+const unsigned char *scan_comment(const unsigned char *s)
+{
+    return scan(SCAN_COMMENT, s);
+}
+
+// the first '\n', '/', '"' or '\''
+const unsigned char *scan_skip(const unsigned char *s)
+{
+    return scan(SCAN_SKIP, s);
+}
+
+/**
+ * The first byte not in [A-Za-z0-9_]. Most identifiers
+ * are short, so the first bytes are tested one by one
+ * before a kernel is worth its setup.
+ */
+const unsigned char *scan_ident(const unsigned char *s)
+{
+    for (int i = 0; i < 16; i++) {
+        if (!is_ident_char(s[i])) {
+            scanned[SCAN_IDENT] += i;
+            calls[SCAN_IDENT]++;
+            return s + i;
+        }
+    }
+    return scan(SCAN_IDENT, s);
+}
+
+void scan_dump(void)
+{
+    dlog("scan: %s kernels.", scanner ? scanner->name : "no");
+    for (int i = 0; i < NKERNELS; i++)
+        dlog("scan: %s: %llu bytes, %llu calls.",
+             kernel_names[i], scanned[i], calls[i]);
+}
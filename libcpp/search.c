@@ -0,0 +1,226 @@
+#include "compat.h"
+#include <stdlib.h>
+#include <dirent.h>
+#include "internal.h"
+#include "libutils.h"
+
+/**
+ * Header search of a translation unit.
+ *
+ * Every lookup is kept, found or not, keyed by the
+ * name, the kind of include and (for a quoted include)
+ * the directory of the including file, so the include
+ * paths are walked once per header.
+ *
+ * Each include directory is also read once into a table
+ * of its entries. A name whose first component is not
+ * there can't be found in that directory, which saves
+ * the stat() calls of the misses.
+ */
+
+#define NLOOKUPS  1024
+#define NDIRS     64
+#define NENTRIES  256
+
+struct lookup {
+    const char *name;
+    const char *dir;            // including directory, NULL if angled
+    bool std;
+    const char *path;           // NULL if not found
+    unsigned int probes;        // stat() calls of the search
+    struct lookup *link;
+};
+
+struct dentry {
+    const char *name;
+    struct dentry *link;
+};
+
+struct sdir {
+    const char *path;
+    bool readable;
+    struct dentry *entries[NENTRIES];
+    struct sdir *link;
+};
+
+static struct lookup *lookups[NLOOKUPS];
+static struct sdir *dirs[NDIRS];
+static struct {
+    unsigned int lookups;
+    unsigned int hits;
+    unsigned int probes;
+    unsigned int saved;
+} stats;
+
+static void free_dir(struct sdir *d)
+{
+    for (int i = 0; i < NENTRIES; i++) {
+        struct dentry *e = d->entries[i];
+        while (e) {
+            struct dentry *link = e->link;
+            free((void *)e->name);
+            free(e);
+            e = link;
+        }
+    }
+    free((void *)d->path);
+    free(d);
+}
+
+// called when a unit starts
+void search_begin(void)
+{
+    for (int i = 0; i < NLOOKUPS; i++) {
+        struct lookup *p = lookups[i];
+        while (p) {
+            struct lookup *link = p->link;
+            free((void *)p->name);
+            free((void *)p->dir);
+            free((void *)p->path);
+            free(p);
+            p = link;
+        }
+        lookups[i] = NULL;
+    }
+    for (int i = 0; i < NDIRS; i++) {
+        struct sdir *d = dirs[i];
+        while (d) {
+            struct sdir *link = d->link;
+            free_dir(d);
+            d = link;
+        }
+        dirs[i] = NULL;
+    }
+    memset(&stats, 0, sizeof(stats));
+}
+
+static struct sdir *read_dir(const char *path)
+{
+    unsigned int h = strhash(path) & (NDIRS - 1);
+    struct sdir *d;
+    DIR *dir;
+    struct dirent *ent;
+
+    for (d = dirs[h]; d; d = d->link)
+        if (!strcmp(d->path, path))
+            return d;
+
+    d = zmalloc(sizeof(struct sdir));
+    d->path = strdup(path);
+    d->link = dirs[h];
+    dirs[h] = d;
+
+    if ((dir = opendir(path)) == NULL)
+        return d;
+    d->readable = true;
+    while ((ent = readdir(dir))) {
+        struct dentry *e = zmalloc(sizeof(struct dentry));
+        unsigned int h = strhash(ent->d_name) & (NENTRIES - 1);
+        e->name = strdup(ent->d_name);
+        e->link = d->entries[h];
+        d->entries[h] = e;
+    }
+    closedir(dir);
+    return d;
+}
+
+// false if 'name' can't be in 'dir'
+static bool may_exist(const char *dir, const char *name)
+{
+    struct sdir *d = read_dir(dir);
+    size_t len = strcspn(name, "/");
+    struct dentry *e;
+
+    // unreadable but searchable directories are stat'ed
+    if (!d->readable)
+        return true;
+#ifdef CONFIG_DARWIN
+    // names are case insensitive there
+    return true;
+#endif
+    for (e = d->entries[strnhash(name, len) & (NENTRIES - 1)]; e; e = e->link)
+        if (!strncmp(e->name, name, len) && e->name[len] == '\0')
+            return true;
+    return false;
+}
+
+static const char *probe(struct lookup *p, const char *dir)
+{
+    char *file;
+
+    if (!may_exist(dir, p->name)) {
+        stats.saved++;
+        return NULL;
+    }
+    file = (char *)join(dir, p->name);
+    p->probes++;
+    stats.probes++;
+    if (cache_fexists(file))
+        return file;
+    free(file);
+    return NULL;
+}
+
+static const char *search(struct lookup *p, struct vector *paths)
+{
+    const char *file;
+
+    for (size_t i = 0; i < vec_len(paths); i++)
+        if ((file = probe(p, vec_at(paths, i))))
+            return file;
+    // quoted: try the directory of the including file
+    if (p->dir)
+        return probe(p, p->dir);
+    return NULL;
+}
+
+/**
+ * Returns the path of header 'name', or NULL if it is
+ * not found. 'from' is the including file.
+ */
+const char *search_header(struct file *pfile, const char *name,
+                          bool std, const char *from)
+{
+    char *dir = NULL;
+    unsigned int h;
+    struct lookup *p;
+
+    // absolute names are never in the tables
+    if (name[0] == '/')
+        return cache_fexists(name) ? name : NULL;
+
+    if (!std) {
+        char *tmp = strdup(from);
+        dir = strdup(dirname(tmp));
+        free(tmp);
+    }
+    h = strhash(name) & (NLOOKUPS - 1);
+    if (dir)
+        h = (h + strhash(dir)) & (NLOOKUPS - 1);
+
+    stats.lookups++;
+    for (p = lookups[h]; p; p = p->link) {
+        if (p->std == std && !strcmp(p->name, name) &&
+            (p->dir == dir || (p->dir && dir && !strcmp(p->dir, dir)))) {
+            free(dir);
+            stats.hits++;
+            stats.saved += p->probes;
+            return p->path;
+        }
+    }
+
+    p = zmalloc(sizeof(struct lookup));
+    p->name = strdup(name);
+    p->dir = dir;
+    p->std = std;
+    p->path = search(p, std ? pfile->std_include_paths : pfile->usr_include_paths);
+    p->link = lookups[h];
+    lookups[h] = p;
+    return p->path;
+}
+
+void search_dump(void)
+{
+    dlog("search: %u lookups, %u cached, %u stats, %u stats saved.",
+         stats.lookups, stats.hits, stats.probes, stats.saved);
+}
@@ -1,45 +1,144 @@
 #include <stdlib.h>
+#include "internal.h"
 #include "libutils.h"
 
-struct strtab {
+/**
+ * The string interner.
+ *
+ * Identifiers, literals and the numbers spelled by strd()
+ * are interned once per process. A string is stored in an
+ * arena after its hash and length (struct string), and the
+ * pointer to its characters is the handle: equal strings
+ * are one pointer, and the tables keyed by them (idtab, the
+ * symbol tables) read STR_HASH() instead of hashing again.
+ *
+ * The table is open addressing with linear probing, and
+ * doubles at a load of 3/4. The hash and length are kept
+ * in the slots too, so a probe only reads the string when
+ * both match.
+ */
+
+#define ARENA_SIZE  (64 * 1024)
+
+struct slot {
+    unsigned int hash;
+    unsigned int len;
     char *str;
-    size_t len;
-    struct strtab *link;
 };
 
-static struct strtab *strtab[1024];
-static unsigned int nelements;
+static struct slot *slots;
+static unsigned int nslots, nelements;
+static char *arena, *arena_limit;
+static size_t nbytes;
 static unsigned int searches;
-static unsigned int collisions;
+static struct probes probes;
 
-char *strn(const char *src, size_t len)
+void probes_add(struct probes *p, unsigned int n)
 {
-    struct strtab *p;
-    unsigned int hash;
-    char *dst;
+    unsigned int i = 0;
+
+    while (i < NPROBES - 1 && n > (1u << i))
+        i++;
+    p->n[i]++;
+}
+
+void probes_dump(const char *name, struct probes *p)
+{
+    dlog("%s: probes 1:%u 2:%u 3-4:%u 5-8:%u 9-16:%u >16:%u.", name,
+         p->n[0], p->n[1], p->n[2], p->n[3], p->n[4], p->n[5]);
+}
+
+static char *store(const char *src, size_t len, unsigned int hash)
+{
+    size_t size = ROUNDUP(sizeof(struct string) + len + 1,
+                          sizeof(struct string));
+    struct string *s;
+
+    if (size > ARENA_SIZE / 4) {
+        s = xmalloc(size);
+    } else {
+        if (arena + size > arena_limit) {
+            arena = xmalloc(ARENA_SIZE);
+            arena_limit = arena + ARENA_SIZE;
+        }
+        s = (struct string *)arena;
+        arena += size;
+    }
+    nbytes += size;
+    s->hash = hash;
+    s->len = len;
+    memcpy(s->str, src, len);
+    s->str[len] = '\0';
+    return s->str;
+}
+
+static void grow(void)
+{
+    unsigned int n = nslots ? nslots * 2 : 4096;
+    struct slot *table = xcalloc(n, sizeof(struct slot));
+
+    for (unsigned int i = 0; i < nslots; i++) {
+        if (slots[i].str) {
+            unsigned int j = slots[i].hash & (n - 1);
+            while (table[j].str)
+                j = (j + 1) & (n - 1);
+            table[j] = slots[i];
+        }
+    }
+    free(slots);
+    slots = table;
+    nslots = n;
+}
+
+// the slot of the string, or the empty one it would take
+static struct slot *probe(const char *src, size_t len, unsigned int hash)
+{
+    unsigned int i = hash & (nslots - 1);
+    unsigned int n = 1;
+    struct slot *p;
 
     searches++;
-    hash = strnhash(src, len) & (ARRAY_SIZE(strtab) - 1);
-    for (p = strtab[hash]; p; p = p->link) {
-        if (p->len == len && !memcmp(src, p->str, len))
-            return p->str;
+    for (p = &slots[i]; p->str; p = &slots[i], n++) {
+        if (p->hash == hash && p->len == len && !memcmp(p->str, src, len))
+            break;
+        i = (i + 1) & (nslots - 1);
     }
+    probes_add(&probes, n);
+    return p;
+}
+
+/**
+ * Interns 'len' bytes of 'src' whose strnhash() is 'hash'.
+ */
+char *strnh(const char *src, size_t len, unsigned int hash)
+{
+    struct slot *p;
 
-    if (strtab[hash])
-        collisions++;
-    nelements++;
-    // alloc
-    dst = xmalloc(len + 1);
-    p = xmalloc(sizeof(struct strtab));
-    p->str = dst;
-    p->len = len;
-    memcpy(dst, src, len);
-    dst[len] = '\0';
-    p->link = strtab[hash];
-    strtab[hash] = p;
+    if (nelements * 4 >= nslots * 3)
+        grow();
+    p = probe(src, len, hash);
+    if (p->str == NULL) {
+        p->hash = hash;
+        p->len = len;
+        p->str = store(src, len, hash);
+        nelements++;
+    }
     return p->str;
 }
 
+// the interned string, NULL if it is not
+const char *strfind(const char *src, size_t len, unsigned int hash)
+{
+    if (nslots == 0)
+        return NULL;
+    return probe(src, len, hash)->str;
+}
+
+char *strn(const char *src, size_t len)
+{
+    return strnh(src, len, strnhash(src, len));
+}
+
 char *strs(const char *str)
 {
     const char *s = str;
@@ -86,6 +185,7 @@ char *stru(unsigned long n)
 
 void strtab_dump(void)
 {
-    dlog("strtab: %u elements, %u slots, %u searches, %u collisions.",
-         nelements, ARRAY_SIZE(strtab), searches, collisions);
+    dlog("strtab: %u elements, %u slots, %lu bytes, %u searches.",
+         nelements, nslots, (unsigned long)nbytes, searches);
+    probes_dump("strtab", &probes);
 }
@@ -28,3 +28,10 @@
 #include <sys/utsname.h>
 // file control
 #include <fcntl.h>
+
+// the modification time of a struct stat, in a struct timespec
+#ifdef CONFIG_DARWIN
+#define ST_MTIM(st)  ((st)->st_mtimespec)
+#else
+#define ST_MTIM(st)  ((st)->st_mtim)
+#endif
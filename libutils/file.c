@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <errno.h>
 #include <assert.h>
+#include <sys/resource.h>
 #include "libutils.h"
 
 const char *mktmpdir()
@@ -28,24 +29,51 @@ long fsize(const char *path)
         return 0;
 }
 
-int proc(const char *file, char **argv)
+int spawn(const char *file, char **argv)
 {
-    pid_t pid;
-    int ret = EXIT_SUCCESS;
-    pid = vfork();
+    return spawnfd(file, argv, -1, -1);
+}
+
+// run with stdin/stdout redirected to 'in'/'out' if they are not -1
+int spawnfd(const char *file, char **argv, int in, int out)
+{
+    pid_t pid = vfork();
     if (pid == 0) {
         // child process
+        if ((in != -1 && dup2(in, 0) == -1) ||
+            (out != -1 && dup2(out, 1) == -1))
+            _exit(127);
         execvp(file, argv);
-    } else if (pid > 0) {
+        _exit(127);
+    } else if (pid < 0) {
+        perror("Can't fork");
+    }
+    return pid;
+}
+
+int proc(const char *file, char **argv)
+{
+    return proc_usage(file, argv, NULL);
+}
+
+// also returns the resource usage of the child in 'ru' (if not NULL),
+// all zero if it could not be run
+int proc_usage(const char *file, char **argv, struct rusage *ru)
+{
+    pid_t pid;
+    int ret = EXIT_SUCCESS;
+    if (ru)
+        memset(ru, 0, sizeof(struct rusage));
+    pid = spawn(file, argv);
+    if (pid > 0) {
         int status;
         int n;
-        while ((n = waitpid(pid, &status, 0)) != pid ||
+        while ((n = wait4(pid, &status, 0, ru)) != pid &&
                (n == -1 && errno == EINTR))
             ; // may be EINTR by a signal, so loop it.
         if (n != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
             ret = EXIT_FAILURE;
     } else {
-        perror("Can't fork");
         ret = EXIT_FAILURE;
     }
 
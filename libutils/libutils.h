@@ -70,7 +70,31 @@ extern int fexists(const char *path);
 extern long fsize(const char *path);
 extern const char *fsuffix(const char *path);
 extern const char *resuffix(const char *path, const char *suffix);
+extern int spawn(const char *file, char **argv);
+extern int spawnfd(const char *file, char **argv, int in, int out);
 extern int proc(const char *file, char **argv);
+struct rusage;
+extern int proc_usage(const char *file, char **argv, struct rusage *ru);
+
+// sha256.c
+struct sha256 {
+    unsigned int h[8];
+    unsigned long long len;
+    unsigned char buf[64];
+};
+extern void sha256_init(struct sha256 *ctx);
+extern void sha256_update(struct sha256 *ctx, const void *data, size_t len);
+extern void sha256_final(struct sha256 *ctx, unsigned char digest[32]);
+extern char *sha256_hex(struct sha256 *ctx);
+
+// socket.c
+extern const char *sock_default_path(void);
+extern int sock_listen(const char *path);
+extern int sock_connect(const char *path);
+extern bool sock_peer_ok(int sock);
+extern int sock_send(int sock, const void *buf, size_t len,
+                     const int *fds, int nfds);
+extern void *sock_recv(int sock, size_t *len, int *fds, int nfds);
 
 // vector.c
 #include "vector.h"
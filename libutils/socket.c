@@ -0,0 +1,223 @@
+// struct ucred
+#ifdef CONFIG_LINUX
+#define _GNU_SOURCE
+#endif
+#include "compat.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "libutils.h"
+
+/**
+ * Messages on a local stream socket are a 4-byte
+ * length followed by the payload. File descriptors
+ * travel as SCM_RIGHTS along with the length.
+ */
+
+#define MAX_FDS  4
+
+static int sock_addr(struct sockaddr_un *addr, const char *path)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+/**
+ * The socket lives in a directory only the user can
+ * enter: $XDG_RUNTIME_DIR, or /tmp/9cc-UID made with
+ * mode 0700. Returns NULL if the directory belongs to
+ * someone else or is open to others.
+ */
+const char *sock_default_path(void)
+{
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    struct stat st;
+
+    if (dir == NULL || dir[0] != '/') {
+        dir = format("/tmp/9cc-%d", (int)getuid());
+        if (mkdir(dir, 0700) < 0 && errno != EEXIST)
+            return NULL;
+    }
+    if (lstat(dir, &st) < 0 || !S_ISDIR(st.st_mode) ||
+        st.st_uid != getuid() || (st.st_mode & 077))
+        return NULL;
+    return format("%s/9cc.sock", dir);
+}
+
+// true if the process at the other end runs as this user
+bool sock_peer_ok(int sock)
+{
+#ifdef CONFIG_LINUX
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+        return false;
+    return cred.uid == getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+
+    if (getpeereid(sock, &uid, &gid) < 0)
+        return false;
+    return uid == getuid();
+#endif
+}
+
+int sock_listen(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (sock_addr(&addr, path) < 0)
+        return -1;
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return -1;
+    // a stale socket of a dead server
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(fd, 64) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int sock_connect(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (sock_addr(&addr, path) < 0)
+        return -1;
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int writen(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int readn(int fd, char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = read(fd, buf, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int sock_send(int sock, const void *buf, size_t len, const int *fds, int nfds)
+{
+    uint32_t n = len;
+    struct iovec iov = { .iov_base = &n, .iov_len = sizeof(n) };
+    union {
+        struct cmsghdr h;
+        char buf[CMSG_SPACE(MAX_FDS * sizeof(int))];
+    } ctl;
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+    ssize_t ret;
+
+    if (nfds > MAX_FDS) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (nfds > 0) {
+        memset(&ctl, 0, sizeof(ctl));
+        msg.msg_control = ctl.buf;
+        msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds, nfds * sizeof(int));
+    }
+    while ((ret = sendmsg(sock, &msg, 0)) < 0 && errno == EINTR)
+        ;
+    if (ret != sizeof(n))
+        return -1;
+    return writen(sock, buf, len);
+}
+
+/**
+ * Returns the payload (NUL terminated) or NULL on error
+ * or end of file. Up to 'nfds' received descriptors are
+ * stored in 'fds', the rest are set to -1.
+ */
+void *sock_recv(int sock, size_t *len, int *fds, int nfds)
+{
+    uint32_t n;
+    struct iovec iov = { .iov_base = &n, .iov_len = sizeof(n) };
+    union {
+        struct cmsghdr h;
+        char buf[CMSG_SPACE(MAX_FDS * sizeof(int))];
+    } ctl;
+    struct msghdr msg = {
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = ctl.buf, .msg_controllen = sizeof(ctl.buf)
+    };
+    ssize_t ret;
+    char *buf;
+
+    for (int i = 0; i < nfds; i++)
+        fds[i] = -1;
+    while ((ret = recvmsg(sock, &msg, 0)) < 0 && errno == EINTR)
+        ;
+    if (ret <= 0)
+        return NULL;
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+        int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        int *p = (int *)CMSG_DATA(cmsg);
+        for (int i = 0; i < count; i++) {
+            if (i < nfds)
+                fds[i] = p[i];
+            else
+                close(p[i]);
+        }
+    }
+
+    if (ret < sizeof(n) && readn(sock, (char *)&n + ret, sizeof(n) - ret) < 0)
+        return NULL;
+    buf = xmalloc(n + 1);
+    if (readn(sock, buf, n) < 0) {
+        free(buf);
+        return NULL;
+    }
+    buf[n] = 0;
+    if (len)
+        *len = n;
+    return buf;
+}
@@ -1,31 +1,75 @@
 #include "compat.h"
+#include <stdint.h>
 #include <limits.h>
 #include <stdio.h>
 #include <ctype.h>
 #include "libutils.h"
 
-#define FNV32_BASIS ((unsigned int) 0x811c9dc5)
-#define FNV32_PRIME ((unsigned int) 0x01000193)
+/**
+ * String hash.
+ *
+ * The string is read 8 bytes at a time, each word xor'ed
+ * into the state, multiplied and folded. The tail of 1-8
+ * bytes is read as two overlapping 32-bit words (or three
+ * bytes if it is shorter than 4), so nothing past the end
+ * is touched. The length seeds the state, which makes the
+ * overlapping reads unambiguous, and the murmur3 finalizer
+ * mixes the high bits down: the tables mask the low bits.
+ */
 
-// FNV-1a
-unsigned int strhash(const char *s)
+#define HASH_K1  0x9e3779b97f4a7c15ULL
+#define HASH_K2  0xff51afd7ed558ccdULL
+#define HASH_K3  0xc4ceb9fe1a85ec53ULL
+
+static inline uint64_t load64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t load32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t hash_word(uint64_t h, uint64_t w)
 {
-    unsigned int hash = FNV32_BASIS;
-    for (; *s; s++) {
-        hash ^= *s;
-        hash *= FNV32_PRIME;
-    }
-    return hash;
+    h = (h ^ w) * HASH_K1;
+    return h ^ (h >> 32);
 }
 
 unsigned int strnhash(const char *s, size_t len)
 {
-    unsigned int hash = FNV32_BASIS;
-    for (size_t i = 0; i < len; i++, s++) {
-        hash ^= *s;
-        hash *= FNV32_PRIME;
-    }
-    return hash;
+    const unsigned char *p = (const unsigned char *)s;
+    const unsigned char *end = p + len;
+    uint64_t h = len * HASH_K1;
+    uint64_t w = 0;
+    size_t n;
+
+    for (; end - p > 8; p += 8)
+        h = hash_word(h, load64(p));
+
+    n = end - p;
+    if (n >= 4)
+        w = load32(p) | load32(end - 4) << 32;
+    else if (n > 0)
+        w = p[0] | (uint64_t)p[n >> 1] << 8 | (uint64_t)p[n - 1] << 16;
+    h = hash_word(h, w);
+
+    h ^= h >> 33;
+    h *= HASH_K2;
+    h ^= h >> 33;
+    h *= HASH_K3;
+    h ^= h >> 33;
+    return (unsigned int)h;
+}
+
+unsigned int strhash(const char *s)
+{
+    return strnhash(s, strlen(s));
 }
 
 char *format(const char *fmt, ...)
@@ -1409,32 +1409,32 @@ static struct type *parse_specifiers(int *sclass, int *fspec)
         if (*p != 0) {
             if (p == &cls) {
                 if (sclass)
-                    error_at(tok->src,
+                    error_at(TOK_SRC(tok),
                              "duplicate storage class '%t'", tok);
                 else
-                    error_at(tok->src,
+                    error_at(TOK_SRC(tok),
                              "type name does not allow storage class "
                              "to be specified");
             } else if (p == &inl) {
                 if (fspec)
-                    warning_at(tok->src,
+                    warning_at(TOK_SRC(tok),
                                "duplicate '%t' declaration specifier",
                                tok);
                 else
-                    error_at(tok->src, "function specifier not allowed");
+                    error_at(TOK_SRC(tok), "function specifier not allowed");
             } else if (p == &cons || p == &res || p == &vol) {
-                warning_at(tok->src,
+                warning_at(TOK_SRC(tok),
                            "duplicate '%t' declaration specifier",
                            tok);
             } else if (p == &ci) {
-                error_at(tok->src,
+                error_at(TOK_SRC(tok),
                          "duplicate _Complex/_Imaginary specifier '%t'",
                          tok);
             } else if (p == &sign) {
-                error_at(tok->src,
+                error_at(TOK_SRC(tok),
                          "duplicate signed/unsigned speficier '%t'", tok);
             } else if (p == &type || p == &size) {
-                error_at(tok->src, "duplicate type specifier '%t'", tok);
+                error_at(TOK_SRC(tok), "duplicate type specifier '%t'", tok);
             } else {
                 CC_UNAVAILABLE();
             }
@@ -1525,7 +1525,7 @@ static struct symbol **parse_prototype(struct type *ftype)
 
         sym = actions.paramdcl(id ? TOK_ID_STR(id) : NULL,
                                ty, sclass, fspec, NULL,
-                               id ? id->src : src);
+                               id ? TOK_SRC(id) : src);
         list = list_append(list, sym);
 
         if (token_is_not(','))
@@ -1557,7 +1557,7 @@ static struct symbol **parse_oldstyle(struct type *ftype)
             const char *name = TOK_ID_STR(token);
             struct symbol *sym;
 
-            sym = actions.paramdcl(name, inttype, 0, 0, NULL, token->src);
+            sym = actions.paramdcl(name, inttype, 0, 0, NULL, TOK_SRC(token));
             sym->defined = false;
             params = list_append(params, sym);
         }
@@ -2035,7 +2035,7 @@ static void parse_struct_body(struct symbol *sym)
                 field->type = ty;
                 if (id) {
                     field->name = TOK_ID_STR(id);
-                    field->src = id->src;
+                    field->src = TOK_SRC(id);
                     // link
                     actions.direct_field(sym, field);
                 }
@@ -2163,7 +2163,7 @@ static void parse_decls(decl_fp dcl)
 
                 funcdef(id ? TOK_ID_STR(id) : NULL,
                         ty, sclass, fspec, params,
-                        id ? id->src : src);
+                        id ? TOK_SRC(id) : src);
                 return;
             } else {
                 exit_params(params);
@@ -2192,9 +2192,9 @@ static void parse_decls(decl_fp dcl)
                 }
 
                 if (sclass == TYPEDEF)
-                    actions.tydefdcl(name, ty, fspec, level, id->src);
+                    actions.tydefdcl(name, ty, fspec, level, TOK_SRC(id));
                 else
-                    dcl(name, ty, sclass, fspec, init, id->src);
+                    dcl(name, ty, sclass, fspec, init, TOK_SRC(id));
             }
 
             if (token_is_not(','))
@@ -2246,6 +2246,7 @@ void translation_unit(void)
             assert(cscope == GLOBAL);
             parse_decls(actions.globaldcl);
             deallocate(FUNC);
+            cpp_release_tokens();
         } else {
             if (token_is(';')) {
                 // empty declaration
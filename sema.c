@@ -243,14 +243,14 @@ static struct symbol *mktmp(struct type *ty, int sclass)
 
 static struct type *integer_constant(struct token *t)
 {
-    int base = t->u.lit.base;
-    int suffix = t->u.lit.suffix;
-    unsigned long n = t->u.lit.v.u;
+    int base = t->u.lit->base;
+    int suffix = t->u.lit->suffix;
+    unsigned long n = t->u.lit->v.u;
     struct type *ty;
 
     // character constant
     if (is_char_cnst(t))
-        return t->u.lit.wide ? wchartype : uchartype;
+        return t->u.lit->wide ? wchartype : uchartype;
 
     switch (suffix) {
     case UNSIGNED + LONG + LONG:
@@ -327,7 +327,7 @@ static struct type *integer_constant(struct token *t)
 
 static struct type *float_constant(struct token *t)
 {
-    int suffix = t->u.lit.suffix;
+    int suffix = t->u.lit->suffix;
     switch (suffix) {
     case FLOAT:
         return floattype;
@@ -342,7 +342,7 @@ static void string_constant(struct token *t, struct symbol *sym)
 {
     const char *s = TOK_LIT_STR(t);
     struct type *ty;
-    if (t->u.lit.wide) {
+    if (t->u.lit->wide) {
         size_t len = strlen(s);
         wchar_t *ws = xmalloc(sizeof(wchar_t) * (len + 1));
         errno = 0;
@@ -915,7 +915,7 @@ arith_literal(struct token *t, struct type * (*cnst) (struct token *))
 
     ty = cnst(t);
     expr = ast_expr(mkop(CNST, ty), ty, NULL, NULL);
-    expr->s.value = token->u.lit.v;
+    expr->s.value = token->u.lit->v;
     return expr;
 }
 
@@ -3429,7 +3429,7 @@ struct tree *cnsts(const char *string)
 {
     struct token t = {
         .id = SCONSTANT,
-        .u.lit.str = format("\"%s\"", string)
+        .u.lit = &(struct literal){ .str = strs(format("\"%s\"", string)) }
     };
     return string_literal(&t, string_constant);
 }
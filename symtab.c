@@ -80,7 +80,7 @@ struct symbol *anonymous(struct table **tpp, int scope, int area)
     static unsigned int i;
     struct symbol *sym;
 
-    sym = install(format("@%u", ++i), tpp, scope, area);
+    sym = install(ids(format("@%u", ++i)), tpp, scope, area);
     sym->anonymous = true;
     return sym;
 }
@@ -103,7 +103,8 @@ struct symbol *lookup(const char *name, struct table * table)
 
     assert(name);
 
-    hash = strhash(name) & (NBUCKETS - 1);
+    // interned, hashed by then
+    hash = STR_HASH(name) & (NBUCKETS - 1);
     for (struct table *t = table; t; t = t->up)
         for (struct entry *p = t->buckets[hash]; p; p = p->link)
             if (name == p->sym.name)
@@ -129,7 +130,7 @@ struct symbol *install(const char *name,
     assert(tp);
 
     // entry
-    hash = strhash(name) & (NBUCKETS - 1);
+    hash = STR_HASH(name) & (NBUCKETS - 1);
     p = NEWS0(struct entry, area);
     p->sym.name = name;
     p->sym.scope = scope;
@@ -141,3 +142,40 @@ struct symbol *install(const char *name,
 
     return &p->sym;
 }
+
+// an incomplete tag stays, a later input may complete it
+static bool private(struct symbol *sym, bool tag)
+{
+    if (tag)
+        return sym->defined;
+    return sym->sclass == STATIC || sym->sclass == TYPEDEF ||
+        sym->sclass == ENUM;
+}
+
+static void hide(struct table *tp, const char *file, bool tag)
+{
+    for (int i = 0; i < NBUCKETS; i++) {
+        struct entry **pp = &tp->buckets[i];
+        while (*pp) {
+            struct symbol *sym = &(*pp)->sym;
+            if (private(sym, tag) &&
+                sym->src.file && !strcmp(sym->src.file, file))
+                *pp = (*pp)->link;
+            else
+                pp = &(*pp)->link;
+        }
+    }
+}
+
+/**
+ * Remove the file-scope statics, typedefs, enumeration
+ * constants and complete tags defined in 'file' from
+ * lookup, so that the next input can define its own.
+ * They stay on the 'all' lists, so the statics are still
+ * emitted and checked at the end of the unit.
+ */
+void hide_file_scope(const char *file)
+{
+    hide(globals, file, false);
+    hide(tags, file, true);
+}
@@ -0,0 +1,114 @@
+/**
+ * Generates the keyword table of libcpp.
+ *
+ *   mkkw [-o output]
+ *
+ * The keywords come from token.def. The table is a
+ * perfect hash on the length and the first and last
+ * characters: the multipliers are searched until no two
+ * keywords share a slot, so a lookup is one probe and
+ * one compare.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct kw {
+    const char *id;
+    const char *name;
+};
+
+static struct kw kws[] = {
+#define _a(a, b, c, d)
+#define _x(a, b, c, d)
+#define _t(a, b, c)
+#define _k(a, b, c)  { #a, b },
+#include "token.def"
+};
+
+#define NKWS  (sizeof(kws) / sizeof(kws[0]))
+#define MAXM  32
+
+static unsigned int hash(const char *s, unsigned int a,
+                         unsigned int b, unsigned int c)
+{
+    size_t len = strlen(s);
+    return len * a + (unsigned char)s[0] * b +
+        (unsigned char)s[len - 1] * c;
+}
+
+// true if the multipliers put no two keywords in one slot
+static int perfect(int *slots, unsigned int size,
+                   unsigned int a, unsigned int b, unsigned int c)
+{
+    for (unsigned int i = 0; i < size; i++)
+        slots[i] = -1;
+    for (unsigned int i = 0; i < NKWS; i++) {
+        unsigned int h = hash(kws[i].name, a, b, c) & (size - 1);
+        if (slots[h] >= 0)
+            return 0;
+        slots[h] = i;
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *fp = stdout;
+    unsigned int size, a, b, c;
+    size_t minlen = ~(size_t)0, maxlen = 0;
+    int *slots;
+
+    if (argc == 3 && !strcmp(argv[1], "-o")) {
+        if ((fp = fopen(argv[2], "w")) == NULL) {
+            fprintf(stderr, "%s: can't write file: %s\n", argv[0], argv[2]);
+            return 1;
+        }
+    } else if (argc != 1) {
+        fprintf(stderr, "usage: %s [-o output]\n", argv[0]);
+        return 1;
+    }
+
+    for (size = 1; size < NKWS; size <<= 1)
+        ;
+    for (;; size <<= 1) {
+        slots = malloc(size * sizeof(int));
+        for (a = 1; a < MAXM; a++)
+            for (b = 1; b < MAXM; b++)
+                for (c = 1; c < MAXM; c++)
+                    if (perfect(slots, size, a, b, c))
+                        goto found;
+        free(slots);
+    }
+
+ found:
+    for (unsigned int i = 0; i < NKWS; i++) {
+        size_t len = strlen(kws[i].name);
+        if (len < minlen)
+            minlen = len;
+        if (len > maxlen)
+            maxlen = len;
+    }
+
+    fprintf(fp, "/* Auto-generated by mkkw from token.def. */\n\n");
+    fprintf(fp, "#define KW_MINLEN  %zu\n", minlen);
+    fprintf(fp, "#define KW_MAXLEN  %zu\n", maxlen);
+    fprintf(fp, "#define KW_HASH(s, len) \\\n"
+            "    (((len) * %u + (s)[0] * %u + (s)[(len) - 1] * %u) & %u)\n\n",
+            a, b, c, size - 1);
+    fprintf(fp, "static const struct keyword kwtab[%u] = {\n", size);
+    for (unsigned int i = 0; i < size; i++) {
+        if (slots[i] < 0)
+            fprintf(fp, "    { NULL, 0, 0 },\n");
+        else
+            fprintf(fp, "    { \"%s\", %zu, %s },\n", kws[slots[i]].name,
+                    strlen(kws[slots[i]].name), kws[slots[i]].id);
+    }
+    fprintf(fp, "};\n");
+
+    free(slots);
+    if (fp != stdout)
+        fclose(fp);
+    return 0;
+}
@@ -0,0 +1,181 @@
+/**
+ * Generates the lexer tables of libcpp.
+ *
+ *   mklex [-o output]
+ *
+ * lex_class[] sorts the first character of a token into
+ * the cases of dolex(), with the punctuators that are no
+ * prefix of another in a class of their own: the token is
+ * the character. The others are recognized by
+ * a DFA: lex_pclass[] numbers the characters they are made
+ * of, lex_next[][] is the transition on that number (0 is
+ * the dead state) and lex_accept[] the token of a state,
+ * 0 if it is only a prefix. The multi-character ones come
+ * from token.def, the single ones and the digraphs are
+ * those of the standard (6.4.6).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct punct {
+    const char *id;
+    const char *name;
+};
+
+static struct punct multi[] = {
+#define _a(a, b, c, d)
+#define _x(a, b, c, d)
+#define _t(a, b, c)  { #a, b },
+#define _k(a, b, c)
+#include "token.def"
+};
+
+static struct punct digraphs[] = {
+    { "'['", "<:" },
+    { "']'", ":>" },
+    { "'{'", "<%" },
+    { "'}'", "%>" },
+    { "'#'", "%:" },
+    { "SHARPSHARP", "%:%:" },
+};
+
+static const char singles[] = "[](){}.&*+-~!/%<>^|?:;=,#";
+
+#define ARRAY_SIZE(a)  (sizeof(a) / sizeof((a)[0]))
+#define MAXSTATES  256
+
+static int pclass[256];
+static unsigned int nclasses = 1;   // 0 is any other character
+static unsigned char next[MAXSTATES][256];
+static const char *accept[MAXSTATES];
+static unsigned int nstates = 2;    // the dead and the start state
+
+static int ispunct_name(const char *s)
+{
+    for (; *s; s++)
+        if (!strchr(singles, *s))
+            return 0;
+    return 1;
+}
+
+static void add(const char *name, const char *id)
+{
+    unsigned int s = 1;
+
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        if (pclass[*p] == 0)
+            pclass[*p] = nclasses++;
+        if (next[s][pclass[*p]] == 0) {
+            if (nstates == MAXSTATES) {
+                fprintf(stderr, "mklex: too many states\n");
+                exit(1);
+            }
+            next[s][pclass[*p]] = nstates++;
+        }
+        s = next[s][pclass[*p]];
+    }
+    accept[s] = id;
+}
+
+// true if 'c' starts no punctuator but itself
+static int single(int c)
+{
+    const unsigned char *row = next[next[1][pclass[c]]];
+
+    for (unsigned int i = 0; i < nclasses; i++)
+        if (row[i])
+            return 0;
+    return 1;
+}
+
+static const char *class_of(int c)
+{
+    if (c == '\n')
+        return "LC_NEWLINE";
+    if (c == ' ' || c == '\t' || c == '\v' || c == '\f' || c == '\r')
+        return "LC_SPACE";
+    if (c == '.')
+        return "LC_DOT";
+    if (c == '/')
+        return "LC_SLASH";
+    if (c && strchr(singles, c))
+        return single(c) ? "LC_SINGLE" : "LC_PUNCT";
+    if (c >= '0' && c <= '9')
+        return "LC_DIGIT";
+    if (c == 'L')
+        return "LC_WIDE";
+    if (c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+        return "LC_IDENT";
+    if (c == '\'')
+        return "LC_CHAR";
+    if (c == '"')
+        return "LC_STRING";
+    return "LC_OTHER";
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *fp = stdout;
+    static char ids[sizeof(singles)][4];
+
+    if (argc == 3 && !strcmp(argv[1], "-o")) {
+        if ((fp = fopen(argv[2], "w")) == NULL) {
+            fprintf(stderr, "%s: can't write file: %s\n", argv[0], argv[2]);
+            return 1;
+        }
+    } else if (argc != 1) {
+        fprintf(stderr, "usage: %s [-o output]\n", argv[0]);
+        return 1;
+    }
+
+    for (unsigned int i = 0; singles[i]; i++) {
+        char name[2] = { singles[i], 0 };
+        snprintf(ids[i], sizeof(ids[i]), "'%c'", singles[i]);
+        add(name, ids[i]);
+    }
+    for (unsigned int i = 0; i < ARRAY_SIZE(multi); i++)
+        if (ispunct_name(multi[i].name))
+            add(multi[i].name, multi[i].id);
+    for (unsigned int i = 0; i < ARRAY_SIZE(digraphs); i++)
+        add(digraphs[i].name, digraphs[i].id);
+
+    fprintf(fp, "/* Auto-generated by mklex from token.def. */\n\n");
+    fprintf(fp, "enum {\n"
+            "    LC_OTHER, LC_NEWLINE, LC_SPACE, LC_SINGLE, LC_PUNCT, LC_DOT,\n"
+            "    LC_SLASH, LC_DIGIT, LC_IDENT, LC_WIDE, LC_CHAR, LC_STRING\n"
+            "};\n\n");
+
+    fprintf(fp, "static const unsigned char lex_class[256] = {\n");
+    for (int c = 0; c < 256; c++)
+        fprintf(fp, "%s%s,%s", c % 4 ? " " : "    ", class_of(c),
+                c % 4 == 3 ? "\n" : "");
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp, "#define LEX_START  1\n\n");
+    fprintf(fp, "static const unsigned char lex_pclass[256] = {\n");
+    for (int c = 0; c < 256; c++)
+        fprintf(fp, "%s%2d,%s", c % 16 ? " " : "    ", pclass[c],
+                c % 16 == 15 ? "\n" : "");
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp, "static const unsigned char lex_next[%u][%u] = {\n",
+            nstates, nclasses);
+    for (unsigned int s = 0; s < nstates; s++) {
+        fprintf(fp, "    {");
+        for (unsigned int c = 0; c < nclasses; c++)
+            fprintf(fp, "%s%u", c ? ", " : " ", next[s][c]);
+        fprintf(fp, " },\n");
+    }
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp, "static const unsigned short lex_accept[%u] = {\n", nstates);
+    for (unsigned int s = 0; s < nstates; s++)
+        fprintf(fp, "    %s,\n", accept[s] ? accept[s] : "0");
+    fprintf(fp, "};\n");
+
+    if (fp != stdout)
+        fclose(fp);
+    return 0;
+}